@@ -12,109 +12,140 @@
 
 
 #include "ILI9488.h"
+#include "lcd_transport.h"
 #include "font.h"
+#include <string.h>
 
 /*
- * A little bit of video RAM to speed things up.
- * The minimum value is 3 (1 byte each for R, G, and B).
- * The theoretical maximum is 0xFFFF - 1 but that doesn't seem to work. Pick a
- * size that suits your RAM budget and works with your controller.
+ * The display set up by lcd_init(), every display set up so far, and the one
+ * being drawn on. Everything that belongs to one display is in lcd_display
+ * (see ILI9488.h) and reached through lcd.
  */
-#define V_BUFFER_SIZE 1024
-uint8_t v_buffer[V_BUFFER_SIZE];
-uint8_t v_buffer_1[V_BUFFER_SIZE];
-uint8_t v_buffer_2[V_BUFFER_SIZE];
-uint16_t buffer_counter = 0;
-uint16_t buffer_counter_1 = 0;
-uint16_t buffer_counter_2 = 0;
-uint8_t active_buffer = 0;
-uint8_t dma_transfer_in_progress = 0;
+lcd_display lcd_default;
+lcd_display *lcd = &lcd_default;
+lcd_display *lcd_displays[LCD_MAX_DISPLAYS];
+int lcd_display_count = 0;
 
 /*
- * Writes a byte to SPI without changing chip select (CS) state.
- * Called by the write_command() and write_data() functions which
- * control these pins as required.
+ * MADCTL values for set_rotation(), each 90 degrees on from the last.
+ * 0x5C and 0x9C are portrait, 0xF8 and 0x3C are landscape.
  */
-void spi_write(unsigned char data) {
+const uint8_t rotation_madctl[4] = {0x5C, 0xF8, 0x9C, 0x3C};
 
-	//Check that the spi port is free
-	while(dma_transfer_in_progress);
+#ifndef LCD_NO_DEFAULT_ARENA
+/*
+ * Arena for lcd_default when the application doesn't give it one
+ */
+uint8_t lcd_default_arena[LCD_ARENA_SIZE] __attribute__((aligned(LCD_ARENA_ALIGN)));
+#endif
 
-	while(HAL_SPI_GetState(&hspi2) != HAL_SPI_STATE_READY);
+//Smallest buffer that holds a whole character for draw_fast_char(). The
+//optional caches are left out of an arena rather than go below this.
+#define ARENA_MIN_BUFFER (8 * 13 * PIXEL_BYTES)
+#define ARENA_ALIGN_UP(a) (((a) + (LCD_ARENA_ALIGN - 1)) & ~(uintptr_t)(LCD_ARENA_ALIGN - 1))
 
-	HAL_SPI_Transmit(&hspi2, &data, 1, 10);
-}
+/*
+ * Frame pacing with the tearing effect (TE) output.
+ * te_count goes up on every TE pulse from lcd_te_callback(). Jobs queued
+ * with lcd_queue_frame() wait here until lcd_frame_sync() runs them.
+ * If there is no TE pulse for TE_TIMEOUT ms the jobs are run anyway.
+ */
+#define FRAME_QUEUE_SIZE 8
+#define TE_TIMEOUT 100
+volatile uint32_t te_count = 0;
+uint8_t te_enabled = 0;
+lcd_frame_job frame_jobs[FRAME_QUEUE_SIZE];
+void *frame_users[FRAME_QUEUE_SIZE];
+int frame_job_count = 0;
+uint8_t frame_started = 0;
+uint32_t last_frame_te = 0;
+uint32_t missed_frames = 0;
+uint32_t frame_count = 0;
+uint32_t frame_tick = 0;
+unsigned int frame_rate = 0;
+uint32_t te_rate_count = 0;
+uint32_t te_tick = 0;
+unsigned int te_rate = 0;
+
+/*
+ * Urgent jobs from lcd_queue_job(). They are run between the rows of
+ * whatever is being drawn (see yield_rows()), so they wait for at most one
+ * row and the DMA buffer already going out. The queue can be filled from
+ * an interrupt: only lcd_queue_job() moves urgent_head and only
+ * lcd_run_urgent() moves urgent_tail.
+ */
+#define URGENT_QUEUE_SIZE 4
+lcd_frame_job volatile urgent_jobs[URGENT_QUEUE_SIZE];
+void * volatile urgent_users[URGENT_QUEUE_SIZE];
+volatile uint8_t urgent_head = 0;
+volatile uint8_t urgent_tail = 0;
+uint8_t urgent_running = 0;
 
 /*
  * Writes the V-RAM buffer to the display.
  */
 void write_buffer() {
-
-	//Check that there isn't a DMA transfer in progress and that the device is free
-	while(dma_transfer_in_progress);
-
-	while(HAL_SPI_GetState(&hspi2) != HAL_SPI_STATE_READY);
-
-	HAL_SPI_Transmit(&hspi2, &v_buffer, buffer_counter, 10);
-	buffer_counter = 0;
+	transport_write(lcd->v_buffer, lcd->buffer_counter);
+	lcd->buffer_counter = 0;
 }
 
 void write_buffer_dma(unsigned char *buffer, int size) {
-
-	//Check if the DMA is busy
-	while(dma_transfer_in_progress);
-
-	//Set the DMA transfer flag to block overwriting
-	dma_transfer_in_progress = 1;
-
-    // Use DMA for SPI transmission
-    HAL_SPI_Transmit_DMA(&hspi2, buffer, size);
-
-}
-
-/*
- * Callback for when the DMA transfer is complete.
- * Clear the flag to allow the next transfer to begin.
- */
-void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi) {
-    if (hspi->Instance == SPI2) {
-        // DMA transfer complete, ready for next buffer
-        dma_transfer_in_progress = 0;
-    }
+	if(size > lcd->buffer_peak)
+		lcd->buffer_peak = size;
+	transport_write_dma(buffer, size);
 }
 
 /*
  * Writes a data byte to the display. Pulls CS low as required.
  */
 void lcd_write_data(unsigned char data) {
-    HAL_GPIO_WritePin(DC_PORT, DC_PIN, GPIO_PIN_SET);
-    HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_RESET);
-
-    spi_write(data);
-
-    //HAL_GPIO_WritePin(DC_PORT, DC_PIN, GPIO_PIN_SET);
-    HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_SET);
+	transport_data(&data, 1);
 }
 
 /*
  * Writes a command byte to the display
  */
 void lcd_write_command(unsigned char data) {
-    HAL_GPIO_WritePin(DC_PORT, DC_PIN, GPIO_PIN_RESET);
-    HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_RESET);
-
-    spi_write(data);
-
-    HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_SET);
+	transport_command(data);
 }
 
 void lcd_write_reg(unsigned int data) {
-    HAL_GPIO_WritePin(DC_PORT, DC_PIN, GPIO_PIN_SET);
-    HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_RESET);
+	unsigned char byte = data;
+	transport_data(&byte, 1);
+}
+
+/*
+ * Writes up to four 16-bit parameters for the last command, high byte
+ * first, as one write. Coordinates and scroll lines go this way, so a
+ * transport with 16-bit SPI frames sends each one as a single frame.
+ */
+void lcd_write_data16(const unsigned int *values, int count) {
+	unsigned char bytes[8];
+
+	if(count > 4)
+		count = 4;
+	for(int i = 0; i < count; i++) {
+		bytes[i * 2] = values[i] >> 8;
+		bytes[i * 2 + 1] = values[i] & 0xFF;
+	}
+	transport_data(bytes, count * 2);
+}
 
-    spi_write(data);
+/*
+ * Holds CS low until lcd_end_transaction(), so all the windows and pixels
+ * drawn in between go out as one chip select session with only DC
+ * changing. Transactions can be nested, CS goes high when the outer one
+ * ends. Under an RTOS the task holds the driver lock for the transaction
+ * too, so no other task can draw while CS is held.
+ */
+void lcd_begin_transaction() {
+	lcd_os_lock();
+	transport_begin_transaction();
+}
 
-    HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_SET);
+void lcd_end_transaction() {
+	transport_end_transaction();
+	lcd_os_unlock();
 }
 
 /*
@@ -156,6 +187,13 @@ void delay_us(long int cycles) {
     while(cycles--);
 }
 
+/*
+ * Forgets the last window, so the next set_draw_window() sends it in full.
+ */
+void invalidate_window() {
+	lcd->window_valid = 0;
+}
+
 /**
  * This is the magic initialisation routine.
  */
@@ -208,12 +246,17 @@ void lcd_init_command_list(void)
 	lcd_write_command(0x36); //RAM address mode
 	//0xF8 and 0x3C are landscape mode. 0x5C and 0x9C for portrait mode.
 	if(LANDSCAPE)
-		lcd_write_data(0xF8);
+		lcd->madctl = rotation_madctl[1];
 	else
-		lcd_write_data(0x5C);
+		lcd->madctl = rotation_madctl[0];
+	lcd_write_data(lcd->madctl);
 
 	lcd_write_command(0x3A); //Interface Mode Control
-	lcd_write_data(0x66); //16-bit serial mode
+#if PIXEL_BYTES == 2
+	lcd_write_data(0x55); //16 bits per pixel on the parallel bus
+#else
+	lcd_write_data(0x66); //18 bits per pixel, the only colour depth over SPI
+#endif
 	lcd_write_command(0xB0); //Interface Mode Control
 	lcd_write_data(0x80); //SDO not in use
 	lcd_write_command(0xB1); //Frame rate 70HZ
@@ -234,31 +277,228 @@ void lcd_init_command_list(void)
 	lcd_write_data(0x2C);
 	lcd_write_data(0x82);
 	lcd_write_command(0x11);
-	HAL_Delay(120);
+	transport_delay(120);
 	lcd_write_command(0x21); //Invert display - channge this if your colours are innverted
 
 
-	HAL_Delay(120);
+	transport_delay(120);
 	lcd_write_command(0x29);
 }
 
 /*
- * Same as above, but initialises with an SPI port instead.
+ * Sets up the default display with hspi2 and the pins in ILI9488.h.
+ * Returns -1 if the display has no arena, or one that is too small.
  */
-void lcd_init() {
+int lcd_init() {
+#if LCD_TRANSPORT == LCD_TRANSPORT_SPI_HAL || LCD_TRANSPORT == LCD_TRANSPORT_SPI_LL
+	lcd_default.spi = &hspi2;
+#elif LCD_TRANSPORT == LCD_TRANSPORT_PARALLEL
+	lcd_default.data_port = DATA_PORT;
+	lcd_default.wr_port = WR_PORT;
+	lcd_default.wr_pin = WR_PIN;
+	lcd_default.rd_port = RD_PORT;
+	lcd_default.rd_pin = RD_PIN;
+#elif LCD_TRANSPORT == LCD_TRANSPORT_FSMC
+	//The FSMC drops address bit 0 on a 16-bit bus, so A16 is bit 17
+	lcd_default.command_address = FSMC_BANK_ADDRESS;
+	lcd_default.data_address = FSMC_BANK_ADDRESS | (1UL << (FSMC_DC_ADDRESS + 1));
+	lcd_default.dma = &FSMC_DMA;
+#endif
+#if !LCD_HOST
+	lcd_default.cs_port = CS_PORT;
+	lcd_default.cs_pin = CS_PIN;
+	lcd_default.dc_port = DC_PORT;
+	lcd_default.dc_pin = DC_PIN;
+	lcd_default.resx_port = RESX_PORT;
+	lcd_default.resx_pin = RESX_PIN;
+#endif
+#ifndef LCD_NO_DEFAULT_ARENA
+	if(!lcd_default.arena) {
+		lcd_default.arena = lcd_default_arena;
+		lcd_default.arena_size = sizeof(lcd_default_arena);
+	}
+#endif
+
+	return lcd_init_display(&lcd_default);
+}
+
+/*
+ * Carves a display's arena in to its buffers. The scaling tables go first
+ * if there is room for them and a character in each buffer, then the
+ * scratch buffer takes LCD_SCRATCH_SIZE and the two DMA buffers share the
+ * rest. An arena too small for that is shared equally by all three.
+ * Returns -1 if the arena doesn't hold a pixel for each buffer.
+ */
+int lcd_carve_arena(lcd_display *display) {
+	uintptr_t start = (uintptr_t)display->arena;
+	uintptr_t end = start + display->arena_size;
+	uintptr_t pos = ARENA_ALIGN_UP(start);
+	uint32_t scratch;
+	uint32_t size;
+
+	display->scale_index = NULL;
+	display->scale_fraction = NULL;
+	if(!display->arena || pos > end)
+		return -1;
+
+	if(end - pos >= ARENA_ALIGN_UP(LCD_SCALE_CACHE_SIZE) + 3 * (ARENA_MIN_BUFFER + LCD_ARENA_ALIGN)) {
+		display->scale_index = (uint16_t *)pos;
+		display->scale_fraction = (uint8_t *)(pos + ILI9488_TFTHEIGHT * sizeof(uint16_t));
+		pos += ARENA_ALIGN_UP(LCD_SCALE_CACHE_SIZE);
+	}
+
+	//Each buffer is a whole number of LCD_ARENA_ALIGN so the next lines up
+	scratch = ARENA_ALIGN_UP(LCD_SCRATCH_SIZE);
+	if(end - pos < scratch + 2 * ARENA_ALIGN_UP(ARENA_MIN_BUFFER))
+		scratch = ((end - pos) / 3) & ~(uint32_t)(LCD_ARENA_ALIGN - 1);
+	size = ((end - pos - scratch) / 2) & ~(uint32_t)(LCD_ARENA_ALIGN - 1);
+	if(scratch < PIXEL_BYTES || size < PIXEL_BYTES)
+		return -1;
+
+	display->v_buffer = (uint8_t *)pos;
+	display->v_buffer_1 = (uint8_t *)pos + scratch;
+	display->v_buffer_2 = (uint8_t *)pos + scratch + size;
+	display->scratch_size = scratch;
+	display->buffer_size = size;
+	display->arena_used = (pos + scratch + 2 * size) - start;
+	display->buffer_peak = 0;
+	return 0;
+}
+
+/*
+ * Resets and sets up a display whose bus, pins and arena have been filled
+ * in, and selects it. Returns -1 if LCD_MAX_DISPLAYS are already in use or
+ * the arena is too small.
+ */
+int lcd_init_display(lcd_display *display) {
+	int i;
+
+	if(lcd_carve_arena(display) < 0)
+		return -1;
+
+	//Remember it so DMA callbacks can find it by its bus
+	for(i = 0; i < lcd_display_count; i++) {
+		if(lcd_displays[i] == display)
+			break;
+	}
+	if(i == lcd_display_count) {
+		if(lcd_display_count == LCD_MAX_DISPLAYS)
+			return -1;
+		lcd_displays[lcd_display_count++] = display;
+	}
+
+	display->dma_transfer_in_progress = 0;
+	display->transaction_depth = 0;
+	display->dma_remaining = 0;
+#if SPI_16BIT_FRAMES
+	display->dma_swapped = NULL;
+	display->dma_tail = -1;
+#endif
+	display->buffer_counter = 0;
+	display->buffer_counter_1 = 0;
+	display->buffer_counter_2 = 0;
+	display->active_buffer = 0;
+	display->width = WIDTH;
+	display->height = HEIGHT;
+	display->scroll_start = 0;
+	display->scroll_size = ILI9488_TFTHEIGHT;
+	display->scroll_offset = 0;
+	lcd_os_init(display);
+	lcd_select(display);
+	reset_clip_rect();
+
     //SET control pins for the LCD HIGH (they are active LOW)
-    HAL_GPIO_WritePin(RESX_PORT, RESX_PIN, GPIO_PIN_SET); //RESET pin HIGH (Active LOW)
-    HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_SET); //Chip Select Active LOW
-    HAL_GPIO_WritePin(DC_PORT, DC_PIN, GPIO_PIN_SET); //Data / Command select Active LOW
+    transport_init();
     //Cycle reset pin
-    HAL_Delay(100);
-    HAL_GPIO_WritePin(RESX_PORT, RESX_PIN, GPIO_PIN_RESET);
-    HAL_Delay(500);
-    HAL_GPIO_WritePin(RESX_PORT, RESX_PIN, GPIO_PIN_SET);
-    HAL_Delay(500);
+    transport_delay(100);
+    transport_reset(0);
+    transport_delay(500);
+    transport_reset(1);
+    transport_delay(500);
 
+    invalidate_window();
     lcd_init_command_list();
 
+    return 0;
+}
+
+/*
+ * How much of the selected display's arena is in use
+ */
+void lcd_arena_usage(lcd_arena_stats *stats) {
+	stats->size = lcd->arena_size;
+	stats->used = lcd->arena_used;
+	stats->scratch = lcd->scratch_size;
+	stats->buffers = 2 * lcd->buffer_size;
+	stats->cache = lcd->scale_index ? LCD_SCALE_CACHE_SIZE : 0;
+	stats->peak = lcd->buffer_peak;
+}
+
+/*
+ * Makes display the one that the drawing functions draw on. Anything still
+ * being sent to the last display carries on.
+ */
+void lcd_select(lcd_display *display) {
+	lcd = display;
+}
+
+/*
+ * For drawing from more than one task under an RTOS. Waits until no other
+ * task has the driver, then selects display. Other tasks wait in lcd_lock(),
+ * lcd_begin_transaction() or any drawing function until lcd_unlock(). Can
+ * be nested.
+ */
+void lcd_lock(lcd_display *display) {
+	lcd_os_lock();
+	lcd_select(display);
+}
+
+void lcd_unlock() {
+	lcd_os_unlock();
+}
+
+/*
+ * Changes the orientation without running lcd_init() again. Only the
+ * MADCTL register is written so it's very quick. rotation is 0 to 3, each
+ * turning the picture another 90 degrees; 0 and 2 are portrait, 1 and 3 are
+ * landscape (1 is the LANDSCAPE orientation from lcd_init()).
+ *
+ * The width and height used for clipping change to match and the clip
+ * rectangle is reset to the whole display. Whatever is already on the
+ * display isn't moved.
+ */
+void set_rotation(int rotation) {
+	lcd_os_lock();
+	rotation &= 3;
+	lcd->madctl = rotation_madctl[rotation];
+	lcd_write_command(ILI9488_MADCTL);
+	lcd_write_data(lcd->madctl);
+
+	if(rotation & 1) {
+		lcd->width = ILI9488_TFTHEIGHT;
+		lcd->height = ILI9488_TFTWIDTH;
+	} else {
+		lcd->width = ILI9488_TFTWIDTH;
+		lcd->height = ILI9488_TFTHEIGHT;
+	}
+
+	invalidate_window();
+	reset_clip_rect();
+
+	//The scroll area is along a different side now
+	reset_scroll();
+	lcd_os_unlock();
+}
+
+/*
+ * Width and height of the display in the current orientation
+ */
+int lcd_width() {
+	return lcd->width;
+}
+
+int lcd_height() {
+	return lcd->height;
 }
 
 /*
@@ -274,108 +514,432 @@ void set_draw_window(unsigned int x1, unsigned int y1, unsigned int x2, unsigned
     if(y2 < y1)
         swap_int(&y2, &y1);
 
-    lcd_write_command(ILI9488_CASET);
-    lcd_write_data(x1 >> 8);
-    lcd_write_data(x1 & 0xFF);
-
-    lcd_write_data(x2 >> 8);
-    lcd_write_data(x2 & 0xFF);
+    //Columns and pages only need sending if they have changed
+    if(!lcd->window_valid || x1 != lcd->window_x1 || x2 != lcd->window_x2) {
+    	unsigned int columns[2] = {x1, x2};
+    	lcd_write_command(ILI9488_CASET);
+    	lcd_write_data16(columns, 2);
+    }
 
-    lcd_write_command(ILI9488_PASET);
-    lcd_write_data(y1 >> 8);
-    lcd_write_data(y1 & 0xFF);
+    if(!lcd->window_valid || y1 != lcd->window_y1 || y2 != lcd->window_y2) {
+    	unsigned int pages[2] = {y1, y2};
+    	lcd_write_command(ILI9488_PASET);
+    	lcd_write_data16(pages, 2);
+    }
 
-    lcd_write_data(y2 >> 8);
-    lcd_write_data(y2 & 0xFF);
+    lcd->window_x1 = x1;
+    lcd->window_x2 = x2;
+    lcd->window_y1 = y1;
+    lcd->window_y2 = y2;
+    lcd->window_valid = 1;
 
     lcd_write_command(ILI9488_RAMWR);
 }
 
+/*
+ * Writes one pixel to dst the way it goes over the bus. The colour is given
+ * as 8-bit R, G, and B. Over SPI that is 3 bytes and the display uses the top
+ * 6 bits of each. A parallel bus takes RGB 5-6-5 as a single 16-bit write, so
+ * it is stored as one native 16-bit word the transport (or DMA) can send
+ * as it is.
+ */
+void pack_rgb(unsigned char *dst, unsigned char r, unsigned char g, unsigned char b) {
+#if PIXEL_BYTES == 2
+	uint16_t colour = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+	memcpy(dst, &colour, 2);
+#else
+	dst[0] = r;
+	dst[1] = g;
+	dst[2] = b;
+#endif
+}
+
+/*
+ * Same as above but takes a 16-bit RGB 5-6-5 colour.
+ */
+void pack_pixel(unsigned char *dst, unsigned int colour) {
+#if PIXEL_BYTES == 2
+	uint16_t c = colour;
+	memcpy(dst, &c, 2);
+#else
+	dst[0] = (colour >> 8) & 0xF8;
+	dst[1] = (colour >> 3) & 0xFC;
+	dst[2] = colour << 3;
+#endif
+}
+
+/*
+ * Adds one pixel to the active DMA buffer. The colour is given as 8-bit
+ * R, G, and B, see pack_rgb().
+ * When the buffer is full it is sent with DMA and the other buffer becomes
+ * active, so the next pixels are prepared while the last ones go out.
+ * CS and DC should already be set up for pixel data.
+ */
+void buffer_rgb(unsigned char r, unsigned char g, unsigned char b) {
+	if (lcd->active_buffer) {
+		pack_rgb(lcd->v_buffer_1 + lcd->buffer_counter_1, r, g, b);
+		lcd->buffer_counter_1 += PIXEL_BYTES;
+
+		// If first buffer is full, start DMA transmission and switch buffers
+		if (lcd->buffer_counter_1 > lcd->buffer_size - PIXEL_BYTES) {
+			write_buffer_dma(lcd->v_buffer_1, lcd->buffer_counter_1);
+			lcd->buffer_counter_1 = 0;
+			lcd->active_buffer = 0; // Switch to second buffer
+		}
+	} else {
+		pack_rgb(lcd->v_buffer_2 + lcd->buffer_counter_2, r, g, b);
+		lcd->buffer_counter_2 += PIXEL_BYTES;
+
+		// If second buffer is full, start DMA transmission and switch buffers
+		if (lcd->buffer_counter_2 > lcd->buffer_size - PIXEL_BYTES) {
+			write_buffer_dma(lcd->v_buffer_2, lcd->buffer_counter_2);
+			lcd->buffer_counter_2 = 0;
+			lcd->active_buffer = 1; // Switch back to first buffer
+		}
+	}
+}
+
+/*
+ * Same as above but takes a 16-bit RGB 5-6-5 colour.
+ */
+void buffer_pixel(unsigned int colour) {
+	buffer_rgb((colour >> 8) & 0xF8, (colour >> 3) & 0xFC, colour << 3);
+}
+
+/*
+ * Fills dst with count copies of the packed pixel px. Copies are done in
+ * blocks that double in size each time rather than a pixel at a time.
+ */
+void fill_run(unsigned char *dst, const unsigned char *px, int count) {
+	int filled = PIXEL_BYTES;
+	int total = count * PIXEL_BYTES;
+	int n;
+
+	memcpy(dst, px, PIXEL_BYTES);
+	while(filled < total) {
+		n = total - filled;
+		if(n > filled)
+			n = filled;
+		memcpy(dst + filled, dst, n);
+		filled += n;
+	}
+}
+
+/*
+ * Adds count copies of the packed pixel px to the DMA buffers, switching
+ * buffers as they fill up like buffer_rgb().
+ */
+void buffer_run(const unsigned char *px, int count) {
+	unsigned char *buffer;
+	uint32_t *counter;
+	int n;
+
+	while(count > 0) {
+		buffer = lcd->active_buffer ? lcd->v_buffer_1 : lcd->v_buffer_2;
+		counter = lcd->active_buffer ? &lcd->buffer_counter_1 : &lcd->buffer_counter_2;
+
+		n = (lcd->buffer_size - *counter) / PIXEL_BYTES;
+		if(n > count)
+			n = count;
+		fill_run(buffer + *counter, px, n);
+		*counter += n * PIXEL_BYTES;
+		count -= n;
+
+		// If the buffer is full, start DMA transmission and switch buffers
+		if (*counter > lcd->buffer_size - PIXEL_BYTES) {
+			write_buffer_dma(buffer, *counter);
+			*counter = 0;
+			lcd->active_buffer = !lcd->active_buffer;
+		}
+	}
+}
+
+/*
+ * Copies count packed pixels in to the DMA buffers, switching buffers as
+ * they fill up like buffer_rgb().
+ */
+void buffer_copy(const unsigned char *px, int count) {
+	unsigned char *buffer;
+	uint32_t *counter;
+	int n;
+
+	while(count > 0) {
+		buffer = lcd->active_buffer ? lcd->v_buffer_1 : lcd->v_buffer_2;
+		counter = lcd->active_buffer ? &lcd->buffer_counter_1 : &lcd->buffer_counter_2;
+
+		n = (lcd->buffer_size - *counter) / PIXEL_BYTES;
+		if(n > count)
+			n = count;
+		memcpy(buffer + *counter, px, n * PIXEL_BYTES);
+		*counter += n * PIXEL_BYTES;
+		px += n * PIXEL_BYTES;
+		count -= n;
+
+		if (*counter > lcd->buffer_size - PIXEL_BYTES) {
+			write_buffer_dma(buffer, *counter);
+			*counter = 0;
+			lcd->active_buffer = !lcd->active_buffer;
+		}
+	}
+}
+
+/*
+ * Returns the active DMA buffer so a whole line of pixels can be built in
+ * it. Anything already waiting in the buffer is sent first.
+ * The line must fit in lcd->buffer_size.
+ */
+unsigned char *line_buffer() {
+	if (lcd->active_buffer) {
+		if (lcd->buffer_counter_1) {
+			write_buffer_dma(lcd->v_buffer_1, lcd->buffer_counter_1);
+			lcd->buffer_counter_1 = 0;
+			lcd->active_buffer = 0;
+		}
+	} else {
+		if (lcd->buffer_counter_2) {
+			write_buffer_dma(lcd->v_buffer_2, lcd->buffer_counter_2);
+			lcd->buffer_counter_2 = 0;
+			lcd->active_buffer = 1;
+		}
+	}
+	return lcd->active_buffer ? lcd->v_buffer_1 : lcd->v_buffer_2;
+}
+
+/*
+ * Sends the line built in the line_buffer() count times, then switches
+ * buffers so the next line can be built while this one is still going out.
+ */
+void send_line(int size, int count) {
+	unsigned char *buffer = lcd->active_buffer ? lcd->v_buffer_1 : lcd->v_buffer_2;
+
+	while(count--)
+		write_buffer_dma(buffer, size);
+	lcd->active_buffer = !lcd->active_buffer;
+}
+
+/*
+ * Sends whatever is left in the active DMA buffer, waits for the transfer
+ * to finish and returns CS to high.
+ */
+void buffer_finish() {
+    // Send remaining bytes in the active buffer
+    if (lcd->active_buffer) {
+    	if (lcd->buffer_counter_1)
+    		write_buffer_dma(lcd->v_buffer_1, lcd->buffer_counter_1);
+    } else {
+    	if (lcd->buffer_counter_2)
+    		write_buffer_dma(lcd->v_buffer_2, lcd->buffer_counter_2);
+    }
+
+    //Reset the buffers
+	lcd->buffer_counter_1 = 0;
+	lcd->buffer_counter_2 = 0;
+    //Wait for the DMA transfer to finish and return CS to high
+    transport_end();
+}
+
+/*
+ * Sets the clip rectangle. Nothing is drawn outside of it.
+ * x2 and y2 are exclusive, so set_clip_rect(0, 0, lcd_width(), lcd_height())
+ * is the whole display.
+ */
+void set_clip_rect(int x1, int y1, int x2, int y2) {
+	lcd->clip_x1 = x1 < 0 ? 0 : x1;
+	lcd->clip_y1 = y1 < 0 ? 0 : y1;
+	lcd->clip_x2 = x2 > lcd->width ? lcd->width : x2;
+	lcd->clip_y2 = y2 > lcd->height ? lcd->height : y2;
+}
+
+/*
+ * Sets the clip rectangle back to the whole display.
+ */
+void reset_clip_rect() {
+	set_clip_rect(0, 0, lcd->width, lcd->height);
+}
+
+/*
+ * Clips the rectangle x1, y1 (inclusive) to x2, y2 (exclusive) against the
+ * clip rectangle. Returns 0 if none of it is visible.
+ */
+int clip_rect(int *x1, int *y1, int *x2, int *y2) {
+	if(*x1 < lcd->clip_x1)
+		*x1 = lcd->clip_x1;
+	if(*y1 < lcd->clip_y1)
+		*y1 = lcd->clip_y1;
+	if(*x2 > lcd->clip_x2)
+		*x2 = lcd->clip_x2;
+	if(*y2 > lcd->clip_y2)
+		*y2 = lcd->clip_y2;
+
+	return (*x1 < *x2) && (*y1 < *y2);
+}
+
 /*
  * Draws a single pixel to the LCD at position X, Y, with
  * Colour.
  *
  * 28 bytes per pixel. Use it wisely.
  */
-void draw_pixel(unsigned int x, unsigned int y, unsigned int colour) {
+void draw_pixel(int x, int y, unsigned int colour) {
+    unsigned char px[PIXEL_BYTES];
 
-    //All my colours are in 16-bit RGB 5-6-5 so they have to be converted to 18-bit RGB
-    unsigned char r = (colour >> 8) & 0xF8;
-    unsigned char g = (colour >> 3) & 0xFC;
-    unsigned char b = (colour << 3);
+	lcd_os_lock();
+	if(x < lcd->clip_x1 || x >= lcd->clip_x2 || y < lcd->clip_y1 || y >= lcd->clip_y2) {
+		lcd_os_unlock();
+		return;
+	}
+
+    //All my colours are in 16-bit RGB 5-6-5 so they have to be converted for the bus
+    pack_pixel(px, colour);
 
     //Set the x, y position that we want to write to
     set_draw_window(x, y, x+1, y+1);
-    lcd_write_data(r);
-    lcd_write_data(g);
-    lcd_write_data(b);
+    transport_begin_data();
+    transport_write(px, PIXEL_BYTES);
+    transport_end();
+    lcd_os_unlock();
 }
 
 /*
  * Fills a rectangle with a given colour
  */
-void fill_rectangle(unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2, unsigned int colour) {
+void fill_rectangle(int x1, int y1, int x2, int y2, unsigned int colour) {
+    lcd_os_lock();
+
+    //Only the visible part is sent
+    if(clip_rect(&x1, &y1, &x2, &y2))
+        fill_window(x1, y1, x2, y2, colour);
+
+    lcd_os_unlock();
+}
+
+/*
+ * Lets urgent jobs in before row y of a window that is being drawn from
+ * x1 to x2 and down to y2 (exclusive). If any are waiting, what is in the
+ * buffers is sent, the jobs run, and the window is set again from row y so
+ * the drawing carries on where it left off. Only call it when nothing still
+ * to be sent is kept in v_buffer or a line buffer.
+ * Returns 1 if jobs were run, as they can have changed the display's tables.
+ */
+int yield_rows(int x1, int y, int x2, int y2) {
+	if(urgent_head == urgent_tail || urgent_running || lcd->rotated)
+		return 0;
+
+	buffer_finish();
+	lcd_run_urgent();
+	set_draw_window(x1, y, x2 - 1, y2 - 1);
+	transport_begin_data();
+	return 1;
+}
+
+/*
+ * Fills a rectangle without clipping it. x2 and y2 are exclusive.
+ */
+void fill_window(int x1, int y1, int x2, int y2, unsigned int colour) {
     //All my colours are in 16-bit RGB 5-6-5 so they have to be converted to 18-bit RGB
     unsigned char r = (colour >> 8) & 0xF8;
     unsigned char g = (colour >> 3) & 0xFC;
     unsigned char b = (colour << 3);
 
+    lcd_os_lock();
 
     //Set the drawing region
-    set_draw_window(x1, y1, x2 - 1, y2);
+    set_draw_window(x1, y1, x2 - 1, y2 - 1);
 
     //We will do the SPI write manually here for speed
     //( the data sheet says it doesn't matter if CS changes between
     // data sections but I don't trust it.)
     //CS low to begin data
-    HAL_GPIO_WritePin(DC_PORT, DC_PIN, GPIO_PIN_SET);
-    HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_RESET);
+    transport_begin_data();
 
 
     //Write colour to each pixel
     for(int y = 0; y < y2 - y1 ; y++) {
+        if(y)
+            yield_rows(x1, y1 + y, x2, y2);
         for(int x = 0; x < x2 - x1 ; x++) {
-			if (active_buffer) {
-				v_buffer_1[buffer_counter_1++] = r;
-				v_buffer_1[buffer_counter_1++] = g;
-				v_buffer_1[buffer_counter_1++] = b;
-
-				// If first buffer is full, start DMA transmission and switch buffers
-				if (buffer_counter_1 > V_BUFFER_SIZE - 3) {
-					write_buffer_dma(v_buffer_1, buffer_counter_1);
-					buffer_counter_1 = 0;
-					active_buffer = 0; // Switch to second buffer
-				}
-			} else {
-				v_buffer_2[buffer_counter_2++] = r;
-				v_buffer_2[buffer_counter_2++] = g;
-				v_buffer_2[buffer_counter_2++] = b;
-
-				// If second buffer is full, start DMA transmission and switch buffers
-				if (buffer_counter_2 > V_BUFFER_SIZE - 3) {
-					write_buffer_dma(v_buffer_2, buffer_counter_2);
-					buffer_counter_2 = 0;
-					active_buffer = 1; // Switch back to first buffer
-				}
-			}
+            buffer_rgb(r, g, b);
         }
     }
 
-    // Send remaining bytes in the active buffer
-    if (active_buffer) {
-        write_buffer_dma(v_buffer_1, buffer_counter_1);
-    } else {
-        write_buffer_dma(v_buffer_2, buffer_counter_2);
-    }
+    //Send the rest of the data and return CS to high
+    buffer_finish();
+    lcd_os_unlock();
+}
 
-    //Reset the buffers
-	buffer_counter_1 = 0;
-	buffer_counter_2 = 0;
-    //Wait for the DMA transfer to finish before pulling CS High
-    while(dma_transfer_in_progress);
+/*
+ * Fills the whole display with white (1) or black (0), whatever the clip
+ * rectangle
+ */
+void clear_screen(int white) {
+	lcd_os_lock();
+	fill_window(0, 0, lcd->width, lcd->height, white ? COLOR_WHITE : COLOR_BLACK);
+	lcd_os_unlock();
+}
 
-    //Return CS to high
-    HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_SET);
+/*
+ * Starts sending pixels to the window x1, y1 to x2, y2 (exclusive). Send
+ * them left to right, top to bottom with write_pixels() and finish with
+ * end_pixels(). The window isn't clipped, use clip_rect() first. The driver
+ * is held until end_pixels(), as in a transaction.
+ */
+void begin_pixels(int x1, int y1, int x2, int y2) {
+	lcd_os_lock();
+	set_draw_window(x1, y1, x2 - 1, y2 - 1);
+	transport_begin_data();
+}
+
+/*
+ * Adds count RGB 5-6-5 pixels to the window started by begin_pixels(). They
+ * are in the same format as a bitmap, so rows can be sent straight from one.
+ */
+void write_pixels(const unsigned int *colours, int count) {
+	while(count-- > 0)
+		buffer_pixel(*colours++);
+}
+
+/*
+ * Sends the last of the pixels and returns CS to high
+ */
+void end_pixels() {
+	buffer_finish();
+	lcd_os_unlock();
+}
+
+/*
+ * Draws a one pixel wide column at x from y1 to y2 (exclusive) as a single
+ * window. span1 to span2 is drawn in colour and the rest in bg_colour, so
+ * a plot can erase its old line and draw the new one in one go.
+ */
+void draw_column_span(int x, int y1, int y2, int span1, int span2, unsigned int colour, unsigned int bg_colour) {
+	unsigned char fg[PIXEL_BYTES], bg[PIXEL_BYTES];
+	int x2 = x + 1;
+
+	lcd_os_lock();
+	if(!clip_rect(&x, &y1, &x2, &y2)) {
+		lcd_os_unlock();
+		return;
+	}
+	if(span1 < y1)
+		span1 = y1;
+	if(span1 > y2)
+		span1 = y2;
+	if(span2 < span1)
+		span2 = span1;
+	if(span2 > y2)
+		span2 = y2;
+
+	pack_pixel(fg, colour);
+	pack_pixel(bg, bg_colour);
+
+	set_draw_window(x, y1, x, y2 - 1);
+	transport_begin_data();
+
+	buffer_run(bg, span1 - y1);
+	buffer_run(fg, span2 - span1);
+	buffer_run(bg, y2 - span2);
+	buffer_finish();
+	lcd_os_unlock();
 }
 
 /*
@@ -386,11 +950,19 @@ void fill_rectangle(unsigned int x1, unsigned int y1, unsigned int x2, unsigned
  * This sends approx. 800 bytes per char to the LCD, but it does preserver
  * the background image. Use the draw_fast_char() function where possible.
  */
-void draw_char(unsigned int x, unsigned int y, char c, unsigned int colour, char size) {
+void draw_char(int x, int y, char c, unsigned int colour, char size) {
     int i, j;
     char line;
     unsigned int font_index = (c - 32);
 
+    lcd_os_lock();
+
+    //Skip characters that are completely clipped
+    if(x + (9 * size) <= lcd->clip_x1 || x >= lcd->clip_x2 || y + (13 * size) <= lcd->clip_y1 || y >= lcd->clip_y2) {
+    	lcd_os_unlock();
+    	return;
+    }
+
     //Get the line of pixels from the font file
     for(i=0; i<13; i++ ) {
 
@@ -410,6 +982,8 @@ void draw_char(unsigned int x, unsigned int y, char c, unsigned int colour, char
             }
         }
     }
+
+    lcd_os_unlock();
 }
 
 /*
@@ -419,41 +993,51 @@ void draw_char(unsigned int x, unsigned int y, char c, unsigned int colour, char
  *
  * NOTE: This sends 130 bytes for a regular sized char
  */
-void draw_fast_char(unsigned int x, unsigned int y, char c, unsigned int colour, unsigned int bg_colour) {
+void draw_fast_char(int x, int y, char c, unsigned int colour, unsigned int bg_colour) {
     char line;
     char width = 8;
     char height = 13;
     unsigned int font_index = (c - 32);
     unsigned int this_px = bg_colour;
+    int x1 = x;
+    int y1 = y;
+    int x2 = x + width;
+    int y2 = y + height;
     //If the buffer is too small to fit a full character then we have to write each pixel
     int smallBuffer = 0;
-    if(V_BUFFER_SIZE < height * width) {
+
+    lcd_os_lock();
+    if(lcd->scratch_size < height * width * PIXEL_BYTES) {
     	smallBuffer++;
     }
 
+    //Only the visible rows and columns of the character are sent
+    if(!clip_rect(&x1, &y1, &x2, &y2)) {
+    	lcd_os_unlock();
+    	return;
+    }
+
     //Set the drawing region
-    set_draw_window(x, y, x + width - 1, y + height);
+    set_draw_window(x1, y1, x2 - 1, y2 - 1);
 
     //We will do the SPI write manually here for speed
     //CS low to begin data
-    HAL_GPIO_WritePin(DC_PORT, DC_PIN, GPIO_PIN_SET);
-    HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_RESET);
+    transport_begin_data();
 
     //Get the line of pixels from the font file
-    for(int i=0; i < height; i++ ) {
+    for(int i = y1 - y; i < y2 - y; i++ ) {
         line = FontLarge[font_index][12 - i];
 
-        //Draw the pixels to screen
-        for(int j = width-1; j >= 0; j--) {
+        //Draw the pixels to screen. Bit 7 is the left-most column.
+        for(int j = width - 1 - (x1 - x); j >= width - (x2 - x); j--) {
             //Default pixel colour is the background colour, unless changed below
             this_px = bg_colour;
 			if((line >> (j)) & 0x01)
 				this_px = colour;
 
             //DCreate the bitmap in the frame buffer
-		    v_buffer[buffer_counter++] = (this_px >> 8) & 0xF8;
-		    v_buffer[buffer_counter++] = (this_px >> 3) & 0xFC;
-		    v_buffer[buffer_counter++] = (this_px << 3);
+		    pack_pixel(lcd->v_buffer + lcd->buffer_counter, this_px);
+		    lcd->buffer_counter += PIXEL_BYTES;
 
 		    //If the buffer was too small for a full font then write each pixel
 		    if(smallBuffer)
@@ -466,7 +1050,8 @@ void draw_fast_char(unsigned int x, unsigned int y, char c, unsigned int colour,
     	write_buffer();
 
     //Return CS to high
-    HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_SET);
+    transport_end();
+    lcd_os_unlock();
 }
 
 
@@ -474,20 +1059,27 @@ void draw_fast_char(unsigned int x, unsigned int y, char c, unsigned int colour,
  * Writes a string to the display as an array of chars at position x, y with
  * a given colour and size.
  */
-void draw_string(unsigned int x, unsigned int y, unsigned int colour, char size, char *str) {
+void draw_string(int x, int y, unsigned int colour, char size, char *str) {
 
     //Work out the size of each character
     int char_width = size * 9;
     //Iterate through each character in the string
     int counter = 0;
+
+    //The whole string goes to one display without other tasks in between
+    lcd_os_lock();
     while(str[counter] != '\0') {
         //Calculate character position
         int char_pos = x + (counter * char_width);
+        //The rest of the string is past the clip rectangle
+        if(char_pos >= lcd->clip_x2)
+        	break;
         //Write char to the display
         draw_char(char_pos, y, str[counter], colour, size);
         //Next character
         counter++;
     }
+    lcd_os_unlock();
 }
 
 /*
@@ -496,94 +1088,1240 @@ void draw_string(unsigned int x, unsigned int y, unsigned int colour, char size,
  * colour should be provided.
  * NOTE: Can only be the regular sized font. No scaling.
  */
-void draw_fast_string(unsigned int x, unsigned int y, unsigned int colour, unsigned int bg_colour, char *str) {
+void draw_fast_string(int x, int y, unsigned int colour, unsigned int bg_colour, char *str) {
     //Iterate through each character in the string
     int counter = 0;
+
+    lcd_os_lock();
     while(str[counter] != '\0') {
+        //The rest of the string is past the clip rectangle
+        if(x + (counter * 9) >= lcd->clip_x2)
+        	break;
         //Write char to the display
         draw_fast_char(x + (counter * 9), y, str[counter], colour, bg_colour);
         //Next character
         counter++;
     }
+    lcd_os_unlock();
+}
+
+/*
+ * Number of screen pixels that source column col covers when it is scaled
+ * and drawn from x1, clipped to dx1 and x2.
+ */
+int scaled_run(int x1, int dx1, int x2, int col, int scale) {
+	int start = x1 + (col * scale);
+	int end = start + scale;
+
+	if (start < dx1)
+		start = dx1;
+	if (end > x2)
+		end = x2;
+	return end - start;
 }
 
 /*
  * Draws a bitmap by directly writing the byte stream to the LCD.
  */
-void draw_bitmap(unsigned int x1, unsigned int y1, int scale, const unsigned int *bmp) {
+void draw_bitmap(int x1, int y1, int scale, const unsigned int *bmp) {
+	draw_bitmap_region(x1, y1, scale, bmp, 0, 0, bmp[0], bmp[1]);
+}
+
+/*
+ * Draws part of a bitmap: the src_w x src_h rectangle at src_x, src_y in
+ * the source. This lets all the icons or animation frames live in a single
+ * atlas bitmap instead of separate arrays. Each source row is read straight from
+ * the atlas using its full width as the stride.
+ */
+void draw_bitmap_region(int x1, int y1, int scale, const unsigned int *bmp,
+		unsigned int src_x, unsigned int src_y, unsigned int src_w, unsigned int src_h) {
     uint16_t width = bmp[0];
     uint16_t height = bmp[1];
     uint16_t this_byte;
-    uint16_t x2 = x1 + (width * scale);
-    uint16_t y2 = y1 + (height * scale);
+    const unsigned int *row;
+    int x2, y2, dx1, dy1;
+    int col, last_col, rep, rows;
+    int line_size;
+    unsigned char *line;
 
 	unsigned char r;
 	unsigned char g;
 	unsigned char b;
 
+	//Keep the source rectangle inside the bitmap
+	if(src_x >= width || src_y >= height || src_w == 0 || src_h == 0)
+		return;
+	if(src_x + src_w > width)
+		src_w = width - src_x;
+	if(src_y + src_h > height)
+		src_h = height - src_y;
+
+	//Work out which part of the scaled image is visible
+	dx1 = x1;
+	dy1 = y1;
+	x2 = x1 + (src_w * scale);
+	y2 = y1 + (src_h * scale);
+	lcd_os_lock();
+	if(!clip_rect(&dx1, &dy1, &x2, &y2)) {
+		lcd_os_unlock();
+		return;
+	}
+
     // Set the drawing region
-    set_draw_window(x1, y1, x2 - 1, y2);
+    set_draw_window(dx1, dy1, x2 - 1, y2 - 1);
 
     // Prepare for SPI transmission
-    HAL_GPIO_WritePin(DC_PORT, DC_PIN, GPIO_PIN_SET);  // Set DC pin for data
-    HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_RESET);  // Set CS pin low for SPI communication
-
-    // Write color to each pixel
-    for (int i = 0; i < height; i++) {
-        for (int sv = 0; sv < scale; sv++) {
-            for (int j = 0; j < width; j++) {
-                // Extract pixel data
-                this_byte = bmp[(width * i) + j + 2];
-
-				//And this loop does the horizontal axis scale (three bytes per pixel))
-				for (int sh = 0; sh < scale; sh++) {
-
-					//Convert 16-bit pixel to 18-bit for the display
-					r = (this_byte >> 8) & 0xF8;
-					g = (this_byte >> 3) & 0xFC;
-					b = (this_byte << 3);
-
-					if (active_buffer) {
-						v_buffer_1[buffer_counter_1++] = r;
-						v_buffer_1[buffer_counter_1++] = g;
-						v_buffer_1[buffer_counter_1++] = b;
-
-						// If first buffer is full, start DMA transmission and switch buffers
-						if (buffer_counter_1 > V_BUFFER_SIZE - 3) {
-							write_buffer_dma(v_buffer_1, buffer_counter_1);
-							buffer_counter_1 = 0;
-							active_buffer = 0; // Switch to second buffer
-						}
-					} else {
-						v_buffer_2[buffer_counter_2++] = r;
-						v_buffer_2[buffer_counter_2++] = g;
-						v_buffer_2[buffer_counter_2++] = b;
-
-						// If second buffer is full, start DMA transmission and switch buffers
-						if (buffer_counter_2 > V_BUFFER_SIZE - 3) {
-							write_buffer_dma(v_buffer_2, buffer_counter_2);
-							buffer_counter_2 = 0;
-							active_buffer = 1; // Switch back to first buffer
-						}
-					}
-				}
-            }
-        }
-    }
-
-    // Send remaining bytes in the active buffer
-    if (active_buffer) {
-        write_buffer_dma(v_buffer_1, buffer_counter_1);
+    transport_begin_data();
+
+    //First and last visible columns in the source
+    col = (dx1 - x1) / scale;
+    last_col = (x2 - 1 - x1) / scale;
+
+    if (scale == 1 || (last_col - col + 1) * PIXEL_BYTES > lcd->scratch_size) {
+    	// Write color to each visible pixel. Clipped rows and columns are skipped.
+    	for (int y = dy1; y < y2; y++) {
+    		if (y > dy1)
+    			yield_rows(dx1, y, x2, y2);
+
+    		//Start of this row in the source. The pixel data starts after the width and height.
+    		row = bmp + 2 + ((src_y + (y - y1) / scale) * width) + src_x;
+
+    		//First visible column, and how many times it still needs to be repeated
+    		col = (dx1 - x1) / scale;
+    		rep = scale - ((dx1 - x1) % scale);
+
+    		for (int x = dx1; x < x2; col++) {
+    			// Extract pixel data
+    			this_byte = row[col];
+
+    			//Convert 16-bit pixel to 18-bit for the display
+    			r = (this_byte >> 8) & 0xF8;
+    			g = (this_byte >> 3) & 0xFC;
+    			b = (this_byte << 3);
+
+    			//And this loop does the horizontal axis scale
+    			for (; rep > 0 && x < x2; rep--, x++) {
+    				buffer_rgb(r, g, b);
+    			}
+    			rep = scale;
+    		}
+    	}
     } else {
-        write_buffer_dma(v_buffer_2, buffer_counter_2);
+    	//Scaled images. Each source row is converted once in to the v_buffer,
+    	//then stretched in to a line with block copies, and that line is sent
+    	//once for every screen row it covers.
+    	line_size = (x2 - dx1) * PIXEL_BYTES;
+
+    	for (int i = (dy1 - y1) / scale; i <= (y2 - 1 - y1) / scale; i++) {
+    		//The last source row has gone, so urgent jobs can use the buffers
+    		if (y1 + (i * scale) > dy1)
+    			yield_rows(dx1, y1 + (i * scale), x2, y2);
+
+    		row = bmp + 2 + ((src_y + i) * width) + src_x;
+
+    		//Convert the visible part of the source row
+    		for (int c = col; c <= last_col; c++) {
+    			pack_pixel(lcd->v_buffer + ((c - col) * PIXEL_BYTES), row[c]);
+    		}
+
+    		//Number of screen rows this source row covers after clipping
+    		rows = y1 + ((i + 1) * scale);
+    		if (rows > y2)
+    			rows = y2;
+    		rows -= (y1 + (i * scale)) < dy1 ? dy1 : (y1 + (i * scale));
+
+    		if (line_size <= lcd->buffer_size) {
+    			line = line_buffer();
+    			for (int c = col; c <= last_col; c++) {
+    				rep = scaled_run(x1, dx1, x2, c, scale);
+    				fill_run(line, lcd->v_buffer + ((c - col) * PIXEL_BYTES), rep);
+    				line += rep * PIXEL_BYTES;
+    			}
+    			send_line(line_size, rows);
+    		} else {
+    			//Too wide for one buffer, so the line is rebuilt for each row
+    			while (rows--) {
+    				for (int c = col; c <= last_col; c++)
+    					buffer_run(lcd->v_buffer + ((c - col) * PIXEL_BYTES), scaled_run(x1, dx1, x2, c, scale));
+    			}
+    		}
+    	}
     }
 
-    //Reset the buffers
-	buffer_counter_1 = 0;
-	buffer_counter_2 = 0;
-    //Wait for the DMA transfer to finish before pulling CS High
-    while(dma_transfer_in_progress);
+    //Send the rest of the data and return CS to high
+    buffer_finish();
+    lcd_os_unlock();
+}
+
+/*
+ * Works out the source position for the middle of destination pixel d in
+ * 16.16 fixed point, when src_size pixels are scaled to dst_size.
+ * It is worked out from scratch rather than adding up a rounded step so
+ * whole number scales land exactly on the source pixels.
+ * For bilinear the position is moved back half a pixel to line up pixel
+ * centres, and kept inside the source so the pixel after it can be read.
+ */
+uint32_t scaled_position(int d, int src_size, int dst_size, int filter) {
+	uint32_t pos = (((uint64_t)((2 * d) + 1) * src_size) << 16) / (2 * dst_size);
+
+	if (filter == SCALE_BILINEAR) {
+		if (pos < 0x8000)
+			return 0;
+		pos -= 0x8000;
+		if (pos > ((uint32_t)(src_size - 1) << 16))
+			pos = (uint32_t)(src_size - 1) << 16;
+	}
+	return pos;
+}
+
+/*
+ * Blends two 8-bit values, fraction/256 of the way from a to b
+ */
+unsigned char blend(int a, int b, int fraction) {
+	return a + (((b - a) * fraction) >> 8);
+}
+
+/*
+ * Works out the colour of visible column k of a scaled line that starts d
+ * columns in to the w wide destination. The source column and fraction
+ * come from the step tables, or are worked out again if the arena had no
+ * room for them. row0 is the source row, and for bilinear, row1 is the one
+ * below it and fy how far to blend towards it.
+ */
+void scaled_pixel(int k, int d, int w, const unsigned int *row0, const unsigned int *row1, int fy, int src_w, int filter,
+		unsigned char *r, unsigned char *g, unsigned char *b) {
+	uint16_t p00, p01, p10, p11;
+	uint32_t pos;
+	int i, fx, i1;
+
+	if (lcd->scale_index) {
+		i = lcd->scale_index[k];
+		fx = lcd->scale_fraction[k];
+	} else {
+		pos = scaled_position(d + k, src_w, w, filter);
+		i = pos >> 16;
+		fx = (pos >> 8) & 0xFF;
+	}
+	i1 = (i + 1 < src_w) ? i + 1 : i;
+
+	if (filter != SCALE_BILINEAR) {
+		p00 = row0[i];
+		*r = (p00 >> 8) & 0xF8;
+		*g = (p00 >> 3) & 0xFC;
+		*b = (p00 << 3);
+		return;
+	}
+
+	p00 = row0[i];
+	p01 = row0[i1];
+	p10 = row1[i];
+	p11 = row1[i1];
+	*r = blend(blend((p00 >> 8) & 0xF8, (p01 >> 8) & 0xF8, fx), blend((p10 >> 8) & 0xF8, (p11 >> 8) & 0xF8, fx), fy);
+	*g = blend(blend((p00 >> 3) & 0xFC, (p01 >> 3) & 0xFC, fx), blend((p10 >> 3) & 0xFC, (p11 >> 3) & 0xFC, fx), fy);
+	*b = blend(blend((p00 << 3) & 0xF8, (p01 << 3) & 0xF8, fx), blend((p10 << 3) & 0xF8, (p11 << 3) & 0xF8, fx), fy);
+}
+
+/*
+ * Fills the display's step tables, if it has them, with the source column
+ * and blend fraction for cols screen columns from column d of a w wide
+ * scaled image
+ */
+void scale_tables(int d, int cols, int src_w, int w, int filter) {
+	uint32_t pos;
+
+	for(int k = 0; lcd->scale_index && k < cols; k++) {
+		pos = scaled_position(d + k, src_w, w, filter);
+		lcd->scale_index[k] = pos >> 16;
+		lcd->scale_fraction[k] = (pos >> 8) & 0xFF;
+	}
+}
+
+/*
+ * Draws a bitmap stretched or shrunk to w x h pixels at x, y. Any size
+ * works, not just whole number multiples.
+ * filter is SCALE_NEAREST (fast) or SCALE_BILINEAR (smoother).
+ *
+ * The source column for each screen column is worked out once per draw in
+ * fixed point and kept in a table. Screen rows that come from the same source position are
+ * built once and the line is sent again for each of them.
+ */
+void draw_bitmap_scaled(int x, int y, int w, int h, const unsigned int *bmp, int filter) {
+	uint16_t src_w = bmp[0];
+	uint16_t src_h = bmp[1];
+	int dx1 = x, dy1 = y;
+	int x2 = x + w;
+	int y2 = y + h;
+	uint32_t pos, next;
+	int rows, cols, fy, i;
+	int line_size;
+	const unsigned int *row0, *row1;
+	unsigned char *line;
+	unsigned char r, g, b;
+
+	if(w <= 0 || h <= 0 || src_w == 0 || src_h == 0)
+		return;
+	lcd_os_lock();
+	if(!clip_rect(&dx1, &dy1, &x2, &y2)) {
+		lcd_os_unlock();
+		return;
+	}
+
+	cols = x2 - dx1;
+	line_size = cols * PIXEL_BYTES;
+
+	//Source column and blend fraction for each visible column
+	scale_tables(dx1 - x, cols, src_w, w, filter);
+
+	//Set the drawing region
+	set_draw_window(dx1, dy1, x2 - 1, y2 - 1);
+
+	//CS low to begin data
+	transport_begin_data();
+
+	for(int d = dy1; d < y2; d += rows) {
+		//Nothing is kept between groups of rows, so urgent jobs can go in.
+		//They can draw scaled images too, so the tables are filled again.
+		if(d > dy1 && yield_rows(dx1, d, x2, y2))
+			scale_tables(dx1 - x, cols, src_w, w, filter);
+
+		pos = scaled_position(d - y, src_h, h, filter);
+
+		//Count the following rows that come out the same. Nearest neighbour
+		//only cares about the source row, bilinear about the fraction too.
+		for(rows = 1; d + rows < y2; rows++) {
+			next = scaled_position(d + rows - y, src_h, h, filter);
+			if(filter == SCALE_BILINEAR ? (next >> 8) != (pos >> 8) : (next >> 16) != (pos >> 16))
+				break;
+		}
+
+		i = pos >> 16;
+		fy = (pos >> 8) & 0xFF;
+		row0 = bmp + 2 + (i * src_w);
+		row1 = (i + 1 < src_h) ? row0 + src_w : row0;
+
+		if(line_size <= lcd->buffer_size) {
+			//Build the line once and send it for each of those rows
+			line = line_buffer();
+			for(int k = 0; k < cols; k++) {
+				scaled_pixel(k, dx1 - x, w, row0, row1, fy, src_w, filter, &r, &g, &b);
+				pack_rgb(line, r, g, b);
+				line += PIXEL_BYTES;
+			}
+			send_line(line_size, rows);
+		} else {
+			//Too wide for one buffer, so the line is rebuilt for each row
+			for(int n = 0; n < rows; n++) {
+				for(int k = 0; k < cols; k++) {
+					scaled_pixel(k, dx1 - x, w, row0, row1, fy, src_w, filter, &r, &g, &b);
+					buffer_rgb(r, g, b);
+				}
+			}
+		}
+	}
+
+	//Send the rest of the data and return CS to high
+	buffer_finish();
+	lcd_os_unlock();
+}
+
+/*
+ * Hardware scrolling.
+ *
+ * The ILI9488 can scroll part of its memory along the 480 pixel side of
+ * the panel, so scrolling only costs a few command bytes plus drawing the
+ * lines that come in to view. That's up and down in portrait, and left
+ * and right in landscape (scroll_vertical() says which).
+ *
+ * Positions here are along that side in the current orientation, so in
+ * portrait they are y values and in landscape x values.
+ */
+
+/*
+ * Returns 1 if hardware scrolling moves things up and down in the current
+ * orientation, or 0 if it moves them left and right.
+ */
+int scroll_vertical() {
+	return !(lcd->madctl & MADCTL_MV);
+}
+
+/*
+ * Returns 1 if the current orientation runs the opposite way to the panel
+ * memory rows, in which case the fixed areas and the offset are flipped.
+ */
+int scroll_reversed() {
+	return (lcd->madctl & MADCTL_MY) != 0;
+}
+
+/*
+ * Sends the scroll area and offset to the display.
+ */
+void write_scroll() {
+	unsigned int top = lcd->scroll_start;
+	unsigned int bottom = ILI9488_TFTHEIGHT - lcd->scroll_start - lcd->scroll_size;
+	unsigned int start;
+	unsigned int area[3];
+
+	if(scroll_reversed()) {
+		top = bottom;
+		bottom = lcd->scroll_start;
+		start = top + ((lcd->scroll_size - lcd->scroll_offset) % lcd->scroll_size);
+	} else {
+		start = top + lcd->scroll_offset;
+	}
+
+	area[0] = top;
+	area[1] = lcd->scroll_size;
+	area[2] = bottom;
+	lcd_write_command(ILI9488_VSCRDEF);
+	lcd_write_data16(area, 3);
+
+	lcd_write_command(ILI9488_VSCRSADD);
+	lcd_write_data16(&start, 1);
+}
+
+/*
+ * Sets up the scrolling area. top_fixed and bottom_fixed are the number of
+ * lines at each end that don't scroll (e.g. a title and status bar), and
+ * everything between them scrolls. The offset goes back to 0.
+ */
+void set_scroll_area(int top_fixed, int bottom_fixed) {
+	if(top_fixed < 0)
+		top_fixed = 0;
+	if(bottom_fixed < 0)
+		bottom_fixed = 0;
+	if(top_fixed + bottom_fixed >= ILI9488_TFTHEIGHT)
+		return;
+
+	lcd_os_lock();
+	lcd->scroll_start = top_fixed;
+	lcd->scroll_size = ILI9488_TFTHEIGHT - top_fixed - bottom_fixed;
+	lcd->scroll_offset = 0;
+	write_scroll();
+	lcd_os_unlock();
+}
+
+/*
+ * Scrolls the scrolling area so that the line offset lines in to it is
+ * shown at the top (or left). Only the start address is sent.
+ */
+void set_scroll_offset(int offset) {
+	unsigned int start;
+
+	lcd_os_lock();
+	offset %= (int)lcd->scroll_size;
+	if(offset < 0)
+		offset += lcd->scroll_size;
+	lcd->scroll_offset = offset;
+
+	lcd_write_command(ILI9488_VSCRSADD);
+	if(scroll_reversed())
+		start = (ILI9488_TFTHEIGHT - lcd->scroll_start - lcd->scroll_size) + ((lcd->scroll_size - lcd->scroll_offset) % lcd->scroll_size);
+	else
+		start = lcd->scroll_start + lcd->scroll_offset;
+	lcd_write_data16(&start, 1);
+	lcd_os_unlock();
+}
+
+/*
+ * Returns the current scroll offset
+ */
+int get_scroll_offset() {
+	return lcd->scroll_offset;
+}
+
+/*
+ * Turns scrolling off, the whole display is shown as normal again.
+ */
+void reset_scroll() {
+	lcd_os_lock();
+	lcd->scroll_start = 0;
+	lcd->scroll_size = ILI9488_TFTHEIGHT;
+	lcd->scroll_offset = 0;
+	write_scroll();
+	lcd_os_unlock();
+}
+
+/*
+ * Works out where to draw so something appears at position pos on the
+ * screen while the display is scrolled. Positions outside the scrolling
+ * area are not moved.
+ */
+int scroll_position(int pos) {
+	if(pos < (int)lcd->scroll_start || pos >= (int)(lcd->scroll_start + lcd->scroll_size))
+		return pos;
+	return lcd->scroll_start + ((pos - lcd->scroll_start + lcd->scroll_offset) % lcd->scroll_size);
+}
+
+/*
+ * Scrolls the scrolling area by lines (positive moves the contents up or
+ * left) and fills the lines that come in to view with colour. Only the new
+ * lines are drawn.
+ */
+void scroll_lines(int lines, unsigned int colour) {
+	int first, last, pos, mem, run;
+	int length;
+
+	if(lines == 0)
+		return;
+
+	lcd_os_lock();
+	length = scroll_vertical() ? lcd->width : lcd->height;
+	if(lines >= (int)lcd->scroll_size || -lines >= (int)lcd->scroll_size)
+		lines = (lines > 0) ? lcd->scroll_size : -(int)lcd->scroll_size;
+
+	set_scroll_offset(lcd->scroll_offset + lines);
+
+	//The new lines are at the end for a positive scroll, or the start
+	if(lines > 0) {
+		first = lcd->scroll_start + lcd->scroll_size - lines;
+		last = lcd->scroll_start + lcd->scroll_size;
+	} else {
+		first = lcd->scroll_start;
+		last = lcd->scroll_start - lines;
+	}
+
+	//Clear them in at most two pieces, as they can wrap around in memory
+	for(pos = first; pos < last; pos += run) {
+		mem = scroll_position(pos);
+		run = last - pos;
+		if(mem + run > (int)(lcd->scroll_start + lcd->scroll_size))
+			run = lcd->scroll_start + lcd->scroll_size - mem;
+
+		if(scroll_vertical())
+			fill_window(0, mem, length, mem + run, colour);
+		else
+			fill_window(mem, 0, mem + run, length, colour);
+	}
+	lcd_os_unlock();
+}
+
+/*
+ * Turns the TE output on (1) or off (0). It pulses once per refresh, at the
+ * start of the vertical blank. Set up TE_PIN as a rising edge interrupt and
+ * call lcd_te_callback() from it.
+ */
+void lcd_tearing_effect(int enable) {
+	lcd_os_lock();
+	if(enable) {
+		lcd_write_command(ILI9488_TEON);
+		lcd_write_data(0x00); //Vertical blank only
+	} else {
+		lcd_write_command(ILI9488_TEOFF);
+	}
+	te_enabled = enable;
+	frame_started = 0;
+	lcd_os_unlock();
+}
+
+/*
+ * Call this from the TE pin interrupt, e.g.
+ *   void HAL_GPIO_EXTI_Callback(uint16_t pin) {
+ *       if(pin == TE_PIN)
+ *           lcd_te_callback();
+ *   }
+ */
+void lcd_te_callback() {
+	uint32_t now = transport_ticks();
+
+	te_count++;
+
+	//Measure the refresh rate of the panel once a second
+	te_rate_count++;
+	if(now - te_tick >= 1000) {
+		te_rate = (te_rate_count * 1000) / (now - te_tick);
+		te_rate_count = 0;
+		te_tick = now;
+	}
+}
+
+/*
+ * Queues some drawing for the next frame. Returns -1 if the queue is full.
+ */
+int lcd_queue_frame(lcd_frame_job job, void *user) {
+	if(frame_job_count >= FRAME_QUEUE_SIZE)
+		return -1;
+	frame_jobs[frame_job_count] = job;
+	frame_users[frame_job_count] = user;
+	frame_job_count++;
+	return 0;
+}
+
+/*
+ * Queues some drawing with a priority. LCD_PRIORITY_NORMAL is the same as
+ * lcd_queue_frame(). An LCD_PRIORITY_URGENT job runs in between the rows of
+ * the drawing that is going out, or in lcd_run_urgent() or lcd_frame_sync()
+ * if nothing is. It can be queued from an interrupt, but only from one
+ * interrupt or task at a time. The job should only draw, as the drawing it
+ * gets in to the middle of can belong to anything.
+ * Returns -1 if the queue is full.
+ */
+int lcd_queue_job(lcd_frame_job job, void *user, int priority) {
+	uint8_t next;
+
+	if(priority != LCD_PRIORITY_URGENT)
+		return lcd_queue_frame(job, user);
+
+	next = (urgent_head + 1) % URGENT_QUEUE_SIZE;
+	if(next == urgent_tail)
+		return -1;
+	urgent_jobs[urgent_head] = job;
+	urgent_users[urgent_head] = user;
+	urgent_head = next;
+	return 0;
+}
 
-    // Return CS pin to high
-    HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_SET);
+/*
+ * Runs the urgent jobs that are waiting. Drawing calls this itself between
+ * rows, call it from the main loop as well so a job doesn't wait for the
+ * next drawing when nothing is going out. The selected display and its
+ * clip rectangle are put back afterwards.
+ * Returns the number of jobs run.
+ */
+int lcd_run_urgent() {
+	lcd_display *display = lcd;
+	int x1, y1, x2, y2;
+	int count = 0;
+
+	if(urgent_head == urgent_tail)
+		return 0;
+
+	lcd_begin_transaction();
+	if(urgent_running) {
+		lcd_end_transaction();
+		return 0;
+	}
+	urgent_running = 1;
+	x1 = lcd->clip_x1;
+	y1 = lcd->clip_y1;
+	x2 = lcd->clip_x2;
+	y2 = lcd->clip_y2;
+
+	while(urgent_tail != urgent_head) {
+		urgent_jobs[urgent_tail](urgent_users[urgent_tail]);
+		urgent_tail = (urgent_tail + 1) % URGENT_QUEUE_SIZE;
+		count++;
+	}
+
+	lcd_select(display);
+	set_clip_rect(x1, y1, x2, y2);
+	urgent_running = 0;
+	lcd_end_transaction();
+	return count;
+}
+
+/*
+ * Waits for the next TE pulse and then runs the queued jobs in order, so
+ * the new frame is written just behind the refresh and doesn't tear.
+ * Calling this in a loop paces animation to the panel refresh instead of
+ * HAL_Delay(). Without TE the jobs run straight away. Urgent jobs are run
+ * while it waits and before the frame.
+ * Returns -1 if TE is on but no pulse came.
+ */
+int lcd_frame_sync() {
+	uint32_t start = transport_ticks();
+	uint32_t seen = te_count;
+	uint32_t now;
+	int result = 0;
+	int count;
+
+	if(te_enabled) {
+		while(te_count == seen) {
+			lcd_run_urgent();
+			if(transport_ticks() - start > TE_TIMEOUT) {
+				result = -1;
+				break;
+			}
+		}
+
+		//Refreshes that went by without a new frame, e.g. the last one took too long
+		seen = te_count;
+		if(frame_started && seen - last_frame_te > 1)
+			missed_frames += seen - last_frame_te - 1;
+		last_frame_te = seen;
+		frame_started = 1;
+	}
+
+	//Jobs can queue more jobs for the frame after. The whole frame is sent
+	//in one transaction.
+	count = frame_job_count;
+	lcd_begin_transaction();
+	lcd_run_urgent();
+	for(int i = 0; i < count; i++)
+		frame_jobs[i](frame_users[i]);
+	lcd_end_transaction();
+	for(int i = count; i < frame_job_count; i++) {
+		frame_jobs[i - count] = frame_jobs[i];
+		frame_users[i - count] = frame_users[i];
+	}
+	frame_job_count -= count;
+
+	frame_count++;
+	now = transport_ticks();
+	if(now - frame_tick >= 1000) {
+		frame_rate = (frame_count * 1000) / (now - frame_tick);
+		frame_count = 0;
+		frame_tick = now;
+	}
+	return result;
+}
+
+/*
+ * Frames per second drawn with lcd_frame_sync(), and the panel refresh
+ * rate measured from TE. Both are updated once a second.
+ */
+unsigned int lcd_fps() {
+	return frame_rate;
+}
+
+unsigned int lcd_refresh_rate() {
+	return te_rate;
+}
+
+/*
+ * Number of refreshes that didn't get a new frame since TE was turned on
+ */
+unsigned int lcd_missed_frames() {
+	return missed_frames;
+}
+
+/*
+ * Works out where logical position c, p (column, page) ends up in the
+ * panel's own 320 x 480 memory for a given MADCTL value. MV swaps the
+ * column and page, then MX and MY mirror them.
+ */
+void physical_position(uint8_t mode, int c, int p, int *px, int *py) {
+	int a = (mode & MADCTL_MV) ? p : c;
+	int b = (mode & MADCTL_MV) ? c : p;
+
+	*px = (mode & MADCTL_MX) ? (ILI9488_TFTWIDTH - 1 - a) : a;
+	*py = (mode & MADCTL_MY) ? (ILI9488_TFTHEIGHT - 1 - b) : b;
+}
+
+/*
+ * The opposite of physical_position(). Works out the logical position of
+ * a point in panel memory for a given MADCTL value.
+ */
+void logical_position(uint8_t mode, int px, int py, int *c, int *p) {
+	int a = (mode & MADCTL_MX) ? (ILI9488_TFTWIDTH - 1 - px) : px;
+	int b = (mode & MADCTL_MY) ? (ILI9488_TFTHEIGHT - 1 - py) : py;
+
+	*c = (mode & MADCTL_MV) ? b : a;
+	*p = (mode & MADCTL_MV) ? a : b;
+}
+
+/*
+ * Where pixel i, j of a w x h image drawn at x, y lands on the screen when
+ * it is rotated clockwise by rotation * 90 degrees.
+ */
+void rotated_position(int x, int y, int w, int h, int rotation, int i, int j, int *dx, int *dy) {
+	switch(rotation) {
+	case ROTATE_90:
+		*dx = x + (h - 1 - j);
+		*dy = y + i;
+		break;
+	case ROTATE_180:
+		*dx = x + (w - 1 - i);
+		*dy = y + (h - 1 - j);
+		break;
+	case ROTATE_270:
+		*dx = x + j;
+		*dy = y + (w - 1 - i);
+		break;
+	default:
+		*dx = x + i;
+		*dy = y + j;
+		break;
+	}
+}
+
+/*
+ * Starts drawing a w x h image at x, y rotated clockwise by rotation * 90
+ * degrees. Rather than rotating the pixels in software, the MADCTL scan
+ * direction is changed for this window so the panel does it, and the image
+ * can be sent in its normal order.
+ *
+ * The part of the image that is still visible after clipping is returned in
+ * sx1, sy1 to sx2, sy2 (exclusive). Send those pixels row by row, then call
+ * end_rotated(). Returns 0, with nothing to send, if it is all clipped.
+ */
+int begin_rotated(int x, int y, int w, int h, int rotation, int *sx1, int *sy1, int *sx2, int *sy2) {
+	int dw = (rotation & 1) ? h : w;
+	int dh = (rotation & 1) ? w : h;
+	int x1 = x, y1 = y, x2 = x + dw, y2 = y + dh;
+	int px, py, ix, iy, jx, jy, ax, ay, bx, by;
+	int c1, p1;
+	uint8_t mode;
+
+	if(!clip_rect(&x1, &y1, &x2, &y2))
+		return 0;
+
+	//Which part of the source image is still visible
+	switch(rotation) {
+	case ROTATE_90:
+		*sx1 = y1 - y;
+		*sx2 = y2 - y;
+		*sy1 = h - (x2 - x);
+		*sy2 = h - (x1 - x);
+		break;
+	case ROTATE_180:
+		*sx1 = w - (x2 - x);
+		*sx2 = w - (x1 - x);
+		*sy1 = h - (y2 - y);
+		*sy2 = h - (y1 - y);
+		break;
+	case ROTATE_270:
+		*sx1 = w - (y2 - y);
+		*sx2 = w - (y1 - y);
+		*sy1 = x1 - x;
+		*sy2 = x2 - x;
+		break;
+	default:
+		*sx1 = x1 - x;
+		*sx2 = x2 - x;
+		*sy1 = y1 - y;
+		*sy2 = y2 - y;
+		break;
+	}
+
+	//Where the first visible pixel, and the ones after and below it, are in panel memory
+	rotated_position(x, y, w, h, rotation, *sx1, *sy1, &ax, &ay);
+	physical_position(lcd->madctl, ax, ay, &px, &py);
+	rotated_position(x, y, w, h, rotation, *sx1 + 1, *sy1, &ax, &ay);
+	physical_position(lcd->madctl, ax, ay, &ix, &iy);
+	rotated_position(x, y, w, h, rotation, *sx1, *sy1 + 1, &ax, &ay);
+	physical_position(lcd->madctl, ax, ay, &jx, &jy);
+
+	//Find the scan direction that steps through memory the same way
+	for(int i = 0; i < 8; i++) {
+		mode = (lcd->madctl & ~(MADCTL_MY | MADCTL_MX | MADCTL_MV)) | (i << 5);
+		physical_position(mode, 0, 0, &ax, &ay);
+		physical_position(mode, 1, 0, &bx, &by);
+		if(bx - ax != ix - px || by - ay != iy - py)
+			continue;
+		physical_position(mode, 0, 1, &bx, &by);
+		if(bx - ax != jx - px || by - ay != jy - py)
+			continue;
+
+		//Use this scan direction just for the window
+		logical_position(mode, px, py, &c1, &p1);
+		lcd_write_command(ILI9488_MADCTL);
+		lcd_write_data(mode);
+		lcd->rotated = 1;
+		invalidate_window();
+		set_draw_window(c1, p1, c1 + (*sx2 - *sx1) - 1, p1 + (*sy2 - *sy1) - 1);
+
+		//CS low to begin data
+		transport_begin_data();
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Finishes a rotated draw and puts the scan direction back.
+ */
+void end_rotated() {
+	buffer_finish();
+
+	lcd_write_command(ILI9488_MADCTL);
+	lcd_write_data(lcd->madctl);
+	lcd->rotated = 0;
+	invalidate_window();
+}
+
+/*
+ * Draws a bitmap rotated clockwise by ROTATE_0, ROTATE_90, ROTATE_180 or
+ * ROTATE_270. The panel does the rotation so this costs the same as
+ * draw_bitmap().
+ */
+void draw_bitmap_rotated(int x, int y, const unsigned int *bmp, int rotation) {
+	int width = bmp[0];
+	int sx1, sy1, sx2, sy2;
+	const unsigned int *row;
+
+	lcd_os_lock();
+	if(!begin_rotated(x, y, bmp[0], bmp[1], rotation, &sx1, &sy1, &sx2, &sy2)) {
+		lcd_os_unlock();
+		return;
+	}
+
+	for(int j = sy1; j < sy2; j++) {
+		row = bmp + 2 + (j * width);
+		for(int i = sx1; i < sx2; i++)
+			buffer_pixel(row[i]);
+	}
+
+	end_rotated();
+	lcd_os_unlock();
+}
+
+/*
+ * Same as draw_fast_char() but rotated clockwise by rotation * 90 degrees.
+ * x, y is the top left of the rotated character.
+ */
+void draw_fast_char_rotated(int x, int y, char c, unsigned int colour, unsigned int bg_colour, int rotation) {
+	unsigned int font_index = (c - 32);
+	int sx1, sy1, sx2, sy2;
+	char line;
+
+	lcd_os_lock();
+	if(!begin_rotated(x, y, 8, 13, rotation, &sx1, &sy1, &sx2, &sy2)) {
+		lcd_os_unlock();
+		return;
+	}
+
+	for(int j = sy1; j < sy2; j++) {
+		line = FontLarge[font_index][12 - j];
+		//Bit 7 is the left-most column
+		for(int i = sx1; i < sx2; i++)
+			buffer_pixel(((line >> (7 - i)) & 0x01) ? colour : bg_colour);
+	}
+
+	end_rotated();
+	lcd_os_unlock();
+}
+
+/*
+ * Same as draw_fast_string() but rotated clockwise by rotation * 90 degrees.
+ * x, y is the top left of the whole rotated string, so with ROTATE_90 it
+ * reads downwards from there, and with ROTATE_180 it ends there.
+ */
+void draw_fast_string_rotated(int x, int y, unsigned int colour, unsigned int bg_colour, char *str, int rotation) {
+	int length = strlen(str);
+
+	lcd_os_lock();
+	for(int i = 0; i < length; i++) {
+		switch(rotation) {
+		case ROTATE_90:
+			draw_fast_char_rotated(x, y + (i * 9), str[i], colour, bg_colour, rotation);
+			break;
+		case ROTATE_180:
+			draw_fast_char_rotated(x + ((length - 1 - i) * 9), y, str[i], colour, bg_colour, rotation);
+			break;
+		case ROTATE_270:
+			draw_fast_char_rotated(x, y + ((length - 1 - i) * 9), str[i], colour, bg_colour, rotation);
+			break;
+		default:
+			draw_fast_char_rotated(x + (i * 9), y, str[i], colour, bg_colour, rotation);
+			break;
+		}
+	}
+	lcd_os_unlock();
+}
+
+/*
+ * Read callback for images that are already in memory (flash or RAM).
+ * user is an lcd_memory_source with the image data and its size. Nothing
+ * past the end is read, the last call returns what is left and then 0.
+ */
+unsigned int lcd_read_memory(void *user, uint32_t offset, uint8_t *buf, unsigned int len) {
+	const lcd_memory_source *src = (const lcd_memory_source *)user;
+
+	if(offset >= src->size)
+		return 0;
+	if(len > src->size - offset)
+		len = src->size - offset;
+	memcpy(buf, src->data + offset, len);
+	return len;
+}
+
+/*
+ * Small input buffer for the streaming decoders so the read callback is
+ * only called once per chunk instead of once per byte.
+ */
+#define READ_CHUNK_SIZE 64
+typedef struct {
+	lcd_read_callback read;
+	void *user;
+	uint32_t offset;
+	uint8_t data[READ_CHUNK_SIZE];
+	unsigned int pos;
+	unsigned int len;
+} byte_source;
+
+/*
+ * Returns the next byte from the source, or -1 if the callback has no
+ * more data.
+ */
+int next_byte(byte_source *src) {
+	if(src->pos >= src->len) {
+		src->len = src->read(src->user, src->offset, src->data, READ_CHUNK_SIZE);
+		src->offset += src->len;
+		src->pos = 0;
+		if(src->len == 0)
+			return -1;
+	}
+	return src->data[src->pos++];
+}
+
+/*
+ * Draws a QOI ("Quite OK Image", qoiformat.org) image at x, y.
+ * The image is decoded as it is read, straight in to the DMA buffers, so
+ * it only needs a few hundred bytes of RAM regardless of the image size.
+ * Decoding the next buffer happens while the last one is being sent.
+ *
+ * The data comes from the read callback, so it can be in flash (use
+ * lcd_read_memory() with an lcd_memory_source), external memory or a file.
+ * The alpha channel is ignored.
+ *
+ * Returns 0 on success, or -1 if the header is bad or the data runs out.
+ */
+int draw_qoi(int x, int y, lcd_read_callback read, void *user) {
+	byte_source src = { read, user, 0, {0}, 0, 0 };
+	uint8_t header[14];
+	uint8_t index[64][4] = {{0}};
+	uint8_t px[4] = {0, 0, 0, 255};
+	uint32_t width, height;
+	int x1 = x, y1 = y, x2, y2;
+	int col = 0, row = 0;
+	int run = 0;
+	int b1, b2;
+	int error = 0;
+
+	//Check the header. Magic "qoif", then big endian width and height
+	for(int i = 0; i < 14; i++) {
+		b1 = next_byte(&src);
+		if(b1 < 0)
+			return -1;
+		header[i] = b1;
+	}
+	if(header[0] != 'q' || header[1] != 'o' || header[2] != 'i' || header[3] != 'f')
+		return -1;
+	width = ((uint32_t)header[4] << 24) | ((uint32_t)header[5] << 16) | (header[6] << 8) | header[7];
+	height = ((uint32_t)header[8] << 24) | ((uint32_t)header[9] << 16) | (header[10] << 8) | header[11];
+	if(width == 0 || height == 0)
+		return -1;
+
+	//Every pixel has to be decoded, but only the visible ones are sent
+	x2 = x + width;
+	y2 = y + height;
+	lcd_os_lock();
+	if(!clip_rect(&x1, &y1, &x2, &y2)) {
+		lcd_os_unlock();
+		return 0;
+	}
+
+	//Set the drawing region
+	set_draw_window(x1, y1, x2 - 1, y2 - 1);
+
+	//CS low to begin data
+	transport_begin_data();
+
+	//Stop once the last visible row has been decoded
+	while(y + row < y2) {
+		if(run) {
+			//Repeat the previous pixel
+			run--;
+		} else {
+			b1 = next_byte(&src);
+			if(b1 < 0) {
+				error = -1;
+				break;
+			}
+
+			if(b1 == 0xFE || b1 == 0xFF) {
+				//QOI_OP_RGB, and QOI_OP_RGBA which has alpha as well
+				b2 = 0;
+				for(int i = 0; i < (b1 == 0xFF ? 4 : 3) && b2 >= 0; i++) {
+					b2 = next_byte(&src);
+					if(b2 >= 0)
+						px[i] = b2;
+				}
+				if(b2 < 0) {
+					error = -1;
+					break;
+				}
+			} else if((b1 & 0xC0) == 0x00) {
+				//QOI_OP_INDEX
+				px[0] = index[b1][0];
+				px[1] = index[b1][1];
+				px[2] = index[b1][2];
+				px[3] = index[b1][3];
+			} else if((b1 & 0xC0) == 0x40) {
+				//QOI_OP_DIFF
+				px[0] += ((b1 >> 4) & 0x03) - 2;
+				px[1] += ((b1 >> 2) & 0x03) - 2;
+				px[2] += (b1 & 0x03) - 2;
+			} else if((b1 & 0xC0) == 0x80) {
+				//QOI_OP_LUMA
+				b2 = next_byte(&src);
+				if(b2 < 0) {
+					error = -1;
+					break;
+				}
+				int vg = (b1 & 0x3F) - 32;
+				px[0] += vg - 8 + ((b2 >> 4) & 0x0F);
+				px[1] += vg;
+				px[2] += vg - 8 + (b2 & 0x0F);
+			} else {
+				//QOI_OP_RUN. This pixel plus (run) more the same.
+				run = b1 & 0x3F;
+			}
+
+			int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) & 0x3F;
+			index[hash][0] = px[0];
+			index[hash][1] = px[1];
+			index[hash][2] = px[2];
+			index[hash][3] = px[3];
+		}
+
+		//QOI pixels are already 8 bits per channel, so no conversion needed
+		if(y + row >= y1 && x + col >= x1 && x + col < x2)
+			buffer_rgb(px[0], px[1], px[2]);
+
+		if(++col == width) {
+			col = 0;
+			row++;
+			//The decoder state is all here, so urgent jobs can go in after
+			//each visible row
+			if(y + row > y1 && y + row < y2)
+				yield_rows(x1, y + row, x2, y2);
+		}
+	}
+
+	//Send the rest of the data and return CS to high
+	buffer_finish();
+	lcd_os_unlock();
+
+	return error;
+}
+
+/*
+ * Draws a width x height bitmap that is read in chunks through a callback,
+ * for images on external flash, SD cards, etc. that can't be mapped in to
+ * memory. The data at offset is 16-bit RGB 5-6-5 pixels, low byte first
+ * (img2hex.py --raw writes this format).
+ *
+ * Each chunk is read in to the v_buffer and converted in to the DMA buffers,
+ * so the next chunk is read while the last one is still being sent.
+ *
+ * Returns 0 on success, or -1 if the data runs out.
+ */
+int draw_bitmap_stream(int x, int y, unsigned int width, unsigned int height, lcd_read_callback read, void *user, uint32_t offset) {
+	int x1 = x, y1 = y;
+	int x2 = x + width;
+	int y2 = y + height;
+	uint32_t span, spans, pixels;
+	uint32_t span_offset;
+	unsigned int len, kept = 0;
+	int error = 0;
+
+	//Only the visible part of the image is read and sent
+	lcd_os_lock();
+	if(!clip_rect(&x1, &y1, &x2, &y2)) {
+		lcd_os_unlock();
+		return 0;
+	}
+
+	//Visible rows are one long run of data unless columns are clipped too
+	if(x2 - x1 == width) {
+		span = width * (y2 - y1);
+		spans = 1;
+	} else {
+		span = x2 - x1;
+		spans = y2 - y1;
+	}
+
+	//Set the drawing region
+	set_draw_window(x1, y1, x2 - 1, y2 - 1);
+
+	//CS low to begin data
+	transport_begin_data();
+
+	for(uint32_t i = 0; i < spans && !error; i++) {
+		span_offset = offset + ((((y1 - y) + i) * width) + (x1 - x)) * 2;
+		pixels = span;
+
+		while(pixels) {
+			len = lcd->scratch_size & ~1;
+			if(pixels * 2 < len)
+				len = pixels * 2;
+
+			//Only whole pixels are used. An odd byte is kept at the start of
+			//the buffer and the next read goes after it.
+			len = read(user, span_offset + kept, lcd->v_buffer + kept, len - kept);
+			if(len == 0) {
+				error = -1;
+				break;
+			}
+			len += kept;
+			kept = len & 1;
+			len -= kept;
+			span_offset += len;
+			pixels -= len / 2;
+
+			for(unsigned int j = 0; j < len; j += 2)
+				buffer_pixel(lcd->v_buffer[j] | (lcd->v_buffer[j + 1] << 8));
+			if(kept)
+				lcd->v_buffer[0] = lcd->v_buffer[len];
+		}
+	}
+
+	//Send the rest of the data and return CS to high
+	buffer_finish();
+	lcd_os_unlock();
+
+	return error;
+}
+
+/*
+ * Draws a width x height block of pixels that are already in the display's
+ * format, PIXEL_BYTES each as pack_pixel() writes them, e.g. a frame buffer
+ * the application draws in to. The pixels are sent from where they are with
+ * DMA, so they must be in RAM and mustn't change until this returns. With
+ * SPI_16BIT_FRAMES on LCD_TRANSPORT_SPI_LL they are copied through the DMA
+ * buffers instead: that DMA reads half words, which 3-byte pixels don't
+ * line up with, and swaps the bytes of what it sends. The pixels are only
+ * ever read.
+ *
+ * When whole rows are visible they go out as a single transfer of any size
+ * (the transport splits it for the DMA), otherwise as one transfer a row.
+ */
+void draw_pixels(int x, int y, int width, int height, uint8_t *pixels) {
+	int x1 = x, y1 = y;
+	int x2 = x + width;
+	int y2 = y + height;
+
+	if(width <= 0 || height <= 0)
+		return;
+	lcd_os_lock();
+	if(!clip_rect(&x1, &y1, &x2, &y2)) {
+		lcd_os_unlock();
+		return;
+	}
+
+	set_draw_window(x1, y1, x2 - 1, y2 - 1);
+	transport_begin_data();
+
+#if SPI_16BIT_FRAMES && LCD_TRANSPORT == LCD_TRANSPORT_SPI_LL
+	for(int row = y1; row < y2; row++)
+		buffer_copy(pixels + ((row - y) * width + (x1 - x)) * PIXEL_BYTES, x2 - x1);
+
+	//Send the rest of the data and return CS to high
+	buffer_finish();
+#else
+	if(x2 - x1 == width) {
+		transport_write_dma(pixels + (y1 - y) * width * PIXEL_BYTES, (y2 - y1) * width * PIXEL_BYTES);
+	} else {
+		for(int row = y1; row < y2; row++)
+			transport_write_dma(pixels + ((row - y) * width + (x1 - x)) * PIXEL_BYTES, (x2 - x1) * PIXEL_BYTES);
+	}
+
+	//Wait for the DMA transfer to finish and return CS to high
+	transport_end();
+#endif
+	lcd_os_unlock();
+}
+
+#if FILE_SOURCE
+/*
+ * Read callback for images in a file. user is the FILE pointer.
+ * Works with anything that provides stdio, including a Linux host.
+ */
+unsigned int lcd_read_file(void *user, uint32_t offset, uint8_t *buf, unsigned int len) {
+	FILE *file = (FILE *)user;
+	if(fseek(file, offset, SEEK_SET) != 0)
+		return 0;
+	return fread(buf, 1, len, file);
 }
+#endif
@@ -10,15 +10,86 @@
 #ifndef ILI9488_H
 #define	ILI9488_H
 
+//Bus used to talk to the display, see lcd_transport.h
+#define LCD_TRANSPORT_SPI_HAL   0 //STM32 HAL SPI with DMA
+#define LCD_TRANSPORT_SPI_LL    1 //SPI registers written directly, DMA for pixels
+#define LCD_TRANSPORT_HOST      2 //Mock display for testing on a PC
+#define LCD_TRANSPORT_PARALLEL  3 //16-bit 8080 parallel bus on GPIO pins
+#define LCD_TRANSPORT_FSMC      4 //16-bit 8080 parallel bus on the FSMC / FMC, memory mapped
+#define LCD_TRANSPORT_HOST_PARALLEL 5 //Mock display on a 16-bit parallel bus
+#ifndef LCD_TRANSPORT
+#define LCD_TRANSPORT LCD_TRANSPORT_SPI_HAL
+#endif
+
+//Set to 1 to send parameters and pixel data over SPI as 16-bit frames, two
+//bytes per frame, which halves the number of FIFO writes and DMA transfers.
+//The frame size is switched by the driver, leave hspi2 set up for 8 bits.
+//Only for an SPI with a selectable frame size like the STM32L4's. Pixel
+//data only uses 16-bit frames with LCD_TRANSPORT_SPI_LL.
+#ifndef SPI_16BIT_FRAMES
+#define SPI_16BIT_FRAMES 0
+#endif
+
+//Operating system the driver runs under, see lcd_os.h. Under an RTOS a task
+//waiting for DMA sleeps until the transfer is done instead of spinning, and
+//tasks take turns with the display through lcd_lock().
+#define LCD_OS_NONE     0 //Bare metal, busy waits
+#define LCD_OS_CMSIS    1 //CMSIS-RTOS2, e.g. FreeRTOS from CubeMX
+#define LCD_OS_PTHREAD  2 //POSIX threads, for testing on a PC
+#ifndef LCD_OS
+#define LCD_OS LCD_OS_NONE
+#endif
+
+#define LCD_HOST (LCD_TRANSPORT == LCD_TRANSPORT_HOST || LCD_TRANSPORT == LCD_TRANSPORT_HOST_PARALLEL)
+#define LCD_PARALLEL (LCD_TRANSPORT == LCD_TRANSPORT_PARALLEL || LCD_TRANSPORT == LCD_TRANSPORT_FSMC || LCD_TRANSPORT == LCD_TRANSPORT_HOST_PARALLEL)
+
+//Bytes per pixel on the bus. SPI only takes 18-bit colour, sent as 3 bytes.
+//The parallel bus takes 16-bit RGB 5-6-5, one write per pixel.
+#if LCD_PARALLEL
+#define PIXEL_BYTES 2
+#else
+#define PIXEL_BYTES 3
+#endif
+
+#if LCD_HOST
+#include <stdint.h>
+#else
 //Set up any ports in your main.c file.
 #include "main.h"
 
+#if !LCD_PARALLEL
 extern SPI_HandleTypeDef hspi2;
+#endif
+#endif
+
+#if LCD_OS == LCD_OS_CMSIS
+#include "cmsis_os2.h"
+#elif LCD_OS == LCD_OS_PTHREAD
+#include <pthread.h>
+#endif
 
-//Hard-coded dimensions of the display
+//Dimensions of the display after lcd_init(). Use set_rotation() to change
+//orientation at run time, and lcd_width() / lcd_height() for the current size.
 #define WIDTH 480 //480
 #define HEIGHT 320 //320
 #define LANDSCAPE   1 //Portrait or Landscape orientation. Update WIDTH and HEIGHT above.
+#ifndef FILE_SOURCE
+#define FILE_SOURCE 0 //Set to 1 to include lcd_read_file() for images in stdio files
+#endif
+
+#if FILE_SOURCE
+#include <stdio.h>
+#endif
+
+//Clockwise rotations for the *_rotated() functions
+#define ROTATE_0    0
+#define ROTATE_90   1
+#define ROTATE_180  2
+#define ROTATE_270  3
+
+//Filters for draw_bitmap_scaled()
+#define SCALE_NEAREST   0
+#define SCALE_BILINEAR  1
 
 //ILI9488 registers found at
 //https://github.com/jaretburkett/ILI9488/blob/master/ILI9488.cpp
@@ -51,7 +122,11 @@ extern SPI_HandleTypeDef hspi2;
 #define ILI9488_RAMRD   0x2E
 
 #define ILI9488_PTLAR   0x30
+#define ILI9488_VSCRDEF 0x33
+#define ILI9488_TEOFF   0x34
+#define ILI9488_TEON    0x35
 #define ILI9488_MADCTL  0x36
+#define ILI9488_VSCRSADD 0x37
 #define ILI9488_PIXFMT  0x3A
 
 #define ILI9488_FRMCTR1 0xB1
@@ -76,6 +151,18 @@ extern SPI_HandleTypeDef hspi2;
 #define ILI9488_GMCTRP1 0xE0
 #define ILI9488_GMCTRN1 0xE1
 
+//MADCTL bits
+#define MADCTL_MY   0x80 //Row address order
+#define MADCTL_MX   0x40 //Column address order
+#define MADCTL_MV   0x20 //Row / column exchange
+#define MADCTL_ML   0x10 //Vertical refresh order
+#define MADCTL_BGR  0x08 //BGR colour order
+#define MADCTL_MH   0x04 //Horizontal refresh order
+
+//Size of the panel memory, before any rotation
+#define ILI9488_TFTWIDTH    320
+#define ILI9488_TFTHEIGHT   480
+
 /* RGB 16-bit color table definition (RG565) */
 #define COLOR_BLACK          0x0000      /*   0,   0,   0 */
 #define COLOR_WHITE          0xFFFF      /* 255, 255, 255 */
@@ -125,20 +212,270 @@ extern SPI_HandleTypeDef hspi2;
 #define RESX_PIN	GPIO_PIN_14 //Reset pin
 #define	DC_PORT		GPIOB
 #define DC_PIN		GPIO_PIN_15 //DATA / Command select
+#define TE_PORT		GPIOB
+#define TE_PIN		GPIO_PIN_12 //Tearing effect input, only used with lcd_frame_sync()
+
+//Parallel bus pins, only used with LCD_TRANSPORT_PARALLEL. D0 to D15 are
+//pins 0 to 15 of one port. CS, DC and RESX are the pins above.
+#define DATA_PORT	GPIOE
+#define	WR_PORT		GPIOD
+#define WR_PIN		GPIO_PIN_5 //Write strobe, data is latched on the rising edge
+#define	RD_PORT		GPIOD
+#define RD_PIN		GPIO_PIN_4 //Read strobe, held high
+
+//FSMC / FMC bank the display is on, only used with LCD_TRANSPORT_FSMC. DC is
+//wired to address line FSMC_DC_ADDRESS so commands and data are written to
+//two addresses. On a 16-bit bus the FSMC address is shifted left by one.
+#define FSMC_BANK_ADDRESS	0x60000000 //Bank 1, NE1
+#define FSMC_DC_ADDRESS		16 //A16
+#define FSMC_DMA		hdma_memtomem_dma2_channel1 //Memory to memory DMA channel from CubeMX
+
+#if LCD_TRANSPORT == LCD_TRANSPORT_FSMC
+extern DMA_HandleTypeDef FSMC_DMA;
+#endif
+
+//Callback used to pull image data from flash, external memory or a file.
+//Copy up to len bytes starting at offset in to buf and return the number
+//of bytes copied (0 when there is no more data). Fewer than len, even one,
+//is fine, the rest is asked for again.
+typedef unsigned int (*lcd_read_callback)(void *user, uint32_t offset, uint8_t *buf, unsigned int len);
+
+//An image that is already in memory (flash or RAM). Pass a pointer to one
+//as the user pointer of lcd_read_memory().
+typedef struct {
+	const uint8_t *data;
+	uint32_t size;
+} lcd_memory_source;
+
+//Drawing queued with lcd_queue_frame() to run at the start of the next frame
+typedef void (*lcd_frame_job)(void *user);
+
+//Priorities for lcd_queue_job(). A normal job waits for the next frame, an
+//urgent one (a cursor, alarm icon or touch feedback) runs as soon as the
+//drawing that is going out reaches the end of a row.
+#define LCD_PRIORITY_NORMAL 0
+#define LCD_PRIORITY_URGENT 1
+
+/*
+ * A little bit of video RAM to speed things up. Each display's buffers are
+ * carved out of one block of memory, its arena (see lcd_display). An
+ * application can give a display its own arena in whatever memory suits,
+ * e.g. DMA capable SRAM rather than DTCM. When lcd_default has none,
+ * lcd_init() uses a static one with two DMA buffers of V_BUFFER_SIZE.
+ * The minimum value is one pixel, PIXEL_BYTES (3 bytes on SPI, 2 on a
+ * parallel bus). There is no maximum, buffers bigger than one DMA transfer
+ * (64 KB) are split up by the transport, and bigger buffers mean fewer
+ * interrupts for each frame. Pick a size that suits your RAM budget.
+ */
+#define V_BUFFER_SIZE 1024
+
+//Each piece carved out of an arena starts on a multiple of this. 4 lets
+//DMA move 16-bit pixels, use the cache line size (32) on parts with a data
+//cache.
+#define LCD_ARENA_ALIGN 4
+
+//Bytes for the step tables of draw_bitmap_scaled(), an optional cache that
+//is only carved out of an arena with room to spare
+#define LCD_SCALE_CACHE_SIZE (ILI9488_TFTHEIGHT * 3)
+
+//Bytes of scratch buffer carved out of an arena. It holds a character for
+//draw_fast_char(), a row of a scaled image or a chunk of a streamed one, so
+//it doesn't grow with the arena. The DMA buffers get the rest.
+#define LCD_SCRATCH_SIZE V_BUFFER_SIZE
+
+//Size of the arena lcd_init() uses when it isn't given one. Define
+//LCD_NO_DEFAULT_ARENA to leave it out, lcd_init() then fails unless
+//lcd_default has an arena.
+#define LCD_ARENA_SIZE (LCD_SCRATCH_SIZE + 2 * V_BUFFER_SIZE + LCD_SCALE_CACHE_SIZE + 4 * LCD_ARENA_ALIGN)
+
+//Most displays that can be set up with lcd_init_display()
+#define LCD_MAX_DISPLAYS 3
+
+#if LCD_HOST
+struct host_panel;
+#endif
+
+/*
+ * Everything the driver keeps for one display: its bus and pins, buffers,
+ * DMA state and drawing state. lcd_init() sets up lcd_default with hspi2 and
+ * the pins above. For more panels on other buses fill in the bus and pins of
+ * another lcd_display, pass it to lcd_init_display() and switch between them
+ * with lcd_select(). Each display has its own DMA state, so one can be
+ * sending while another is drawn.
+ */
+typedef struct {
+	//Bus and pins, set before lcd_init_display()
+#if LCD_TRANSPORT == LCD_TRANSPORT_SPI_HAL || LCD_TRANSPORT == LCD_TRANSPORT_SPI_LL
+	SPI_HandleTypeDef *spi;
+#elif LCD_TRANSPORT == LCD_TRANSPORT_PARALLEL
+	GPIO_TypeDef *data_port, *wr_port, *rd_port;
+	uint16_t wr_pin, rd_pin;
+#elif LCD_TRANSPORT == LCD_TRANSPORT_FSMC
+	uint32_t command_address, data_address;
+	DMA_HandleTypeDef *dma;
+#elif LCD_HOST
+	struct host_panel *panel; //Emulated display, see transport_host.c
+	const uint8_t * volatile host_dma_data; //Transfer left running with host_dma_async
+	volatile unsigned int host_dma_len;
+#endif
+#if !LCD_HOST
+	GPIO_TypeDef *cs_port, *dc_port, *resx_port;
+	uint16_t cs_pin, dc_pin, resx_pin;
+#endif
+
+	//Transfer state, used by the transport. A DMA transfer longer than
+	//TRANSPORT_DMA_MAX goes in pieces, dma_next and dma_remaining are what
+	//the completion interrupt starts next.
+	volatile uint8_t dma_transfer_in_progress;
+	uint8_t transaction_depth;
+	const uint8_t *dma_next;
+	uint32_t dma_remaining;
+
+	//Given by the DMA completion interrupt for tasks waiting in
+	//lcd_os_wait(), see lcd_os.h
+#if LCD_OS == LCD_OS_CMSIS
+	osSemaphoreId_t dma_done;
+#elif LCD_OS == LCD_OS_PTHREAD
+	pthread_mutex_t dma_mutex;
+	pthread_cond_t dma_done;
+	uint8_t dma_ready;
+#endif
+#if SPI_16BIT_FRAMES
+	uint8_t *dma_swapped;
+	unsigned int dma_swapped_len;
+	int dma_tail;
+#endif
+
+	//Memory for the buffers, set before lcd_init_display(). Any size and
+	//alignment, lcd_init_display() lines the pieces up to LCD_ARENA_ALIGN.
+	uint8_t *arena;
+	uint32_t arena_size;
+
+	//Carved out of the arena by lcd_init_display(). v_buffer is scratch for
+	//blocking writes (characters) and reading images, v_buffer_1 and
+	//v_buffer_2 take turns being filled and sent with DMA. The scaling
+	//tables are NULL if the arena didn't have room for them.
+	uint8_t *v_buffer;
+	uint8_t *v_buffer_1;
+	uint8_t *v_buffer_2;
+	uint32_t scratch_size;
+	uint32_t buffer_size;
+	uint16_t *scale_index;
+	uint8_t *scale_fraction;
+	uint32_t arena_used;
+	uint32_t buffer_peak;
+	uint32_t buffer_counter;
+	uint32_t buffer_counter_1;
+	uint32_t buffer_counter_2;
+	uint8_t active_buffer;
+
+	//The MADCTL (memory access control) value for the current orientation.
+	//Rotated drawing changes it for a moment and puts this back afterwards,
+	//and urgent jobs aren't let in while it is changed.
+	uint8_t madctl;
+	uint8_t rotated;
+
+	//Size of the display in the current orientation
+	int width;
+	int height;
+
+	//The last column and page range sent by set_draw_window(). If a window
+	//uses the same range again it doesn't need to be sent.
+	//Cleared by invalidate_window() when the controller state might not match.
+	uint8_t window_valid;
+	unsigned int window_x1, window_x2, window_y1, window_y2;
+
+	//Hardware scrolling area, as a start and size along the 480 line side of
+	//the panel in the current orientation, and how far it is scrolled.
+	unsigned int scroll_start;
+	unsigned int scroll_size;
+	unsigned int scroll_offset;
+
+	//Everything drawn is clipped to this rectangle. x2 and y2 are exclusive,
+	//the same as fill_rectangle(). It is always kept inside the display.
+	int clip_x1, clip_y1, clip_x2, clip_y2;
+} lcd_display;
+
+/*
+ * How a display's arena is used, from lcd_arena_usage()
+ */
+typedef struct {
+	uint32_t size;		//Bytes in the arena
+	uint32_t used;		//Bytes carved out of it, including alignment
+	uint32_t scratch;	//Bytes of scratch buffer
+	uint32_t buffers;	//Bytes of DMA buffers, both of them
+	uint32_t cache;		//Bytes of caches, 0 if there wasn't room
+	uint32_t peak;		//Most bytes sent from a DMA buffer at once since lcd_init_display()
+} lcd_arena_stats;
+
+extern lcd_display lcd_default;
+extern lcd_display *lcd;
+extern lcd_display *lcd_displays[LCD_MAX_DISPLAYS];
+extern int lcd_display_count;
 
 
+#if LCD_TRANSPORT == LCD_TRANSPORT_SPI_HAL
 void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi);
-void lcd_init();
-void draw_pixel(unsigned int x, unsigned int y, unsigned int colour);
-void fill_rectangle(unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2, unsigned int colour);
-void draw_char(unsigned int x, unsigned int y, char c, unsigned int colour, char size);
-void draw_fast_char(unsigned int x, unsigned int y, char c, unsigned int colour, unsigned int bg_colour);
-void draw_string(unsigned int x, unsigned int y, unsigned int colour, char size, char *str);
-void draw_fast_string(unsigned int x, unsigned int y, unsigned int colour, unsigned int bg_colour, char *str);
+#endif
+int lcd_init();
+int lcd_init_display(lcd_display *display);
+void lcd_select(lcd_display *display);
+void lcd_lock(lcd_display *display);
+void lcd_unlock();
+void lcd_arena_usage(lcd_arena_stats *stats);
+void lcd_begin_transaction();
+void lcd_end_transaction();
+void set_rotation(int rotation);
+int lcd_width();
+int lcd_height();
+void set_clip_rect(int x1, int y1, int x2, int y2);
+void reset_clip_rect();
+int clip_rect(int *x1, int *y1, int *x2, int *y2);
+void draw_pixel(int x, int y, unsigned int colour);
+void fill_rectangle(int x1, int y1, int x2, int y2, unsigned int colour);
+void fill_window(int x1, int y1, int x2, int y2, unsigned int colour);
+void begin_pixels(int x1, int y1, int x2, int y2);
+void write_pixels(const unsigned int *colours, int count);
+void end_pixels();
+void draw_column_span(int x, int y1, int y2, int span1, int span2, unsigned int colour, unsigned int bg_colour);
+void draw_char(int x, int y, char c, unsigned int colour, char size);
+void draw_fast_char(int x, int y, char c, unsigned int colour, unsigned int bg_colour);
+void draw_string(int x, int y, unsigned int colour, char size, char *str);
+void draw_fast_string(int x, int y, unsigned int colour, unsigned int bg_colour, char *str);
 void draw_line(unsigned int x1, unsigned int y1, char x2, char y2, unsigned int colour);
-void draw_bitmap(unsigned int x, unsigned int y, int scale, const unsigned int *bmp);
+void draw_bitmap(int x, int y, int scale, const unsigned int *bmp);
+void draw_bitmap_region(int x, int y, int scale, const unsigned int *bmp,
+		unsigned int src_x, unsigned int src_y, unsigned int src_w, unsigned int src_h);
+void draw_bitmap_scaled(int x, int y, int w, int h, const unsigned int *bmp, int filter);
+void draw_bitmap_rotated(int x, int y, const unsigned int *bmp, int rotation);
+void draw_fast_char_rotated(int x, int y, char c, unsigned int colour, unsigned int bg_colour, int rotation);
+void draw_fast_string_rotated(int x, int y, unsigned int colour, unsigned int bg_colour, char *str, int rotation);
 void fill_fast_rectangle(unsigned int x1, unsigned int y1, unsigned int colour);
 void clear_screen(int white);
+int scroll_vertical();
+void set_scroll_area(int top_fixed, int bottom_fixed);
+void set_scroll_offset(int offset);
+int get_scroll_offset();
+void reset_scroll();
+int scroll_position(int pos);
+void scroll_lines(int lines, unsigned int colour);
+void lcd_tearing_effect(int enable);
+void lcd_te_callback();
+int lcd_queue_frame(lcd_frame_job job, void *user);
+int lcd_queue_job(lcd_frame_job job, void *user, int priority);
+int lcd_run_urgent();
+int lcd_frame_sync();
+unsigned int lcd_fps();
+unsigned int lcd_refresh_rate();
+unsigned int lcd_missed_frames();
+unsigned int lcd_read_memory(void *user, uint32_t offset, uint8_t *buf, unsigned int len);
+int draw_qoi(int x, int y, lcd_read_callback read, void *user);
+int draw_bitmap_stream(int x, int y, unsigned int width, unsigned int height, lcd_read_callback read, void *user, uint32_t offset);
+void pack_pixel(unsigned char *dst, unsigned int colour);
+void draw_pixels(int x, int y, int width, int height, uint8_t *pixels);
+#if FILE_SOURCE
+unsigned int lcd_read_file(void *user, uint32_t offset, uint8_t *buf, unsigned int len);
+#endif
 
 #endif	/* ILI9488_H */
 
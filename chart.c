@@ -0,0 +1,136 @@
+/*
+ * Strip chart for plotting live data on the ILI9488.
+ *
+ * Each new sample only draws the one column it lands in. The column is sent
+ * as a single window that covers the old trace in that column and the new
+ * one, so the old trace is erased and the new one drawn at the same time.
+ * The cost of a sample depends on how far the trace moves, not on the size
+ * of the chart.
+ *
+ * File:   chart.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "chart.h"
+
+/*
+ * Sets up a chart at x, y that is width x height pixels and plots values
+ * from min (bottom) to max (top), then clears it.
+ * CHART_SCROLL uses the hardware scrolling, which on this panel only moves
+ * whole columns in a landscape orientation. The chart then has to be the
+ * full height of the display and takes over the scrolling area. Anywhere
+ * else it falls back to CHART_SWEEP, as shifting the whole chart in
+ * software would cost as much as redrawing it.
+ */
+void chart_init(strip_chart *chart, int x, int y, int width, int height, int min, int max,
+		unsigned int colour, unsigned int bg_colour, int mode) {
+	if(width > ILI9488_TFTHEIGHT)
+		width = ILI9488_TFTHEIGHT;
+	if(width < 1)
+		width = 1;
+	if(height < 1)
+		height = 1;
+	if(max == min)
+		max = min + 1;
+
+	chart->x = x;
+	chart->y = y;
+	chart->width = width;
+	chart->height = height;
+	chart->min = min;
+	chart->max = max;
+	chart->colour = colour;
+	chart->bg_colour = bg_colour;
+	chart->mode = mode;
+
+	chart->hardware = (mode == CHART_SCROLL) && !scroll_vertical()
+			&& x >= 0 && x + width <= lcd_width()
+			&& y == 0 && height == lcd_height();
+	if(chart->hardware)
+		set_scroll_area(x, lcd_width() - x - width);
+
+	chart_clear(chart);
+}
+
+/*
+ * Clears the chart and starts again from the first column
+ */
+void chart_clear(strip_chart *chart) {
+	for(int i = 0; i < chart->width; i++) {
+		chart->top[i] = 0;
+		chart->bottom[i] = 0;
+	}
+	chart->position = 0;
+	chart->last = -1;
+
+	if(chart->hardware)
+		set_scroll_offset(0);
+	fill_rectangle(chart->x, chart->y, chart->x + chart->width, chart->y + chart->height, chart->bg_colour);
+}
+
+/*
+ * Row in the chart for a value, 0 is the top
+ */
+int chart_row(strip_chart *chart, int value) {
+	if(value <= chart->min)
+		return chart->height - 1;
+	if(value >= chart->max)
+		return 0;
+	return (chart->height - 1)
+			- (int)(((int64_t)(value - chart->min) * (chart->height - 1)) / (chart->max - chart->min));
+}
+
+/*
+ * Plots the next sample. The line from the last sample is drawn in a single
+ * column, together with erasing whatever was in that column before.
+ */
+void chart_add(strip_chart *chart, int value) {
+	int column = chart->position;
+	int row = chart_row(chart, value);
+	int top, bottom, old_top, old_bottom;
+
+	//The trace joins on to the last sample
+	if(chart->last < 0 || chart->last == row) {
+		top = row;
+		bottom = row + 1;
+	} else if(chart->last < row) {
+		top = chart->last + 1;
+		bottom = row + 1;
+	} else {
+		top = row;
+		bottom = chart->last;
+	}
+
+	//The window only needs to cover the old and new lines
+	old_top = chart->top[column];
+	old_bottom = chart->bottom[column];
+	if(old_top == old_bottom) {
+		old_top = top;
+		old_bottom = bottom;
+	}
+	draw_column_span(chart->x + column,
+			chart->y + (old_top < top ? old_top : top),
+			chart->y + (old_bottom > bottom ? old_bottom : bottom),
+			chart->y + top, chart->y + bottom,
+			chart->colour, chart->bg_colour);
+
+	chart->top[column] = top;
+	chart->bottom[column] = bottom;
+	chart->last = row;
+	chart->position = (column + 1) % chart->width;
+
+	//Scroll so the column just drawn shows on the right hand side
+	if(chart->hardware)
+		set_scroll_offset(chart->position);
+}
+
+/*
+ * Plots several samples, e.g. a block from an ADC DMA buffer
+ */
+void chart_add_samples(strip_chart *chart, const int *values, int count) {
+	for(int i = 0; i < count; i++)
+		chart_add(chart, values[i]);
+}
@@ -0,0 +1,41 @@
+/*
+ * Strip chart for plotting live data on the ILI9488
+ *
+ * File:   chart.h
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+#ifndef CHART_H
+#define	CHART_H
+
+#include "ILI9488.h"
+
+//Chart modes
+#define CHART_SWEEP     0 //New samples sweep across the chart and wrap, like an oscilloscope
+#define CHART_SCROLL    1 //The chart scrolls left with the newest sample on the right
+
+/*
+ * One chart. The columns remember which rows of the trace were drawn in them
+ * so they can be erased again without clearing the whole column first.
+ */
+typedef struct {
+	int x, y, width, height;
+	int min, max;
+	unsigned int colour, bg_colour;
+	int mode;
+	int hardware;	//Scrolling with the display's hardware scrolling
+	int position;	//Column the next sample is drawn in
+	int last;		//Row of the last sample, or -1 if there isn't one
+	uint16_t top[ILI9488_TFTHEIGHT];
+	uint16_t bottom[ILI9488_TFTHEIGHT];
+} strip_chart;
+
+void chart_init(strip_chart *chart, int x, int y, int width, int height, int min, int max,
+		unsigned int colour, unsigned int bg_colour, int mode);
+void chart_clear(strip_chart *chart);
+void chart_add(strip_chart *chart, int value);
+void chart_add_samples(strip_chart *chart, const int *values, int count);
+
+#endif	/* CHART_H */
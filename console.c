@@ -0,0 +1,316 @@
+/*
+ * Scrolling text console for the ILI9488 driver.
+ *
+ * Text is written in to a grid of character cells and console_update() only
+ * draws the cells that are different to what is on the screen. When the
+ * console fills the width of a portrait display it scrolls with the panel's
+ * hardware scrolling, so a new line only costs clearing that line.
+ *
+ * File:   console.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "console.h"
+#include <string.h>
+
+#define CONSOLE_CELLS (CONSOLE_MAX_COLUMNS * CONSOLE_MAX_ROWS)
+
+//Set on a shown cell while the cursor is drawn over it
+#define CURSOR_FLAG 0x80
+
+/*
+ * The text and colours of each cell, and what was last drawn on the screen.
+ * Colours are one byte per cell, foreground palette index in the top four
+ * bits and background in the bottom four.
+ * A shown char of 0 means the screen isn't known and the cell is redrawn.
+ */
+char console_char[CONSOLE_CELLS];
+uint8_t console_attr[CONSOLE_CELLS];
+char shown_char[CONSOLE_CELLS];
+uint8_t shown_attr[CONSOLE_CELLS];
+
+unsigned int console_palette[16] = {
+	COLOR_BLACK, COLOR_NAVY, COLOR_DARKGREEN, COLOR_DARKCYAN,
+	COLOR_DARKRED, COLOR_INDIGO, COLOR_OLIVE, COLOR_LIGHTGREY,
+	COLOR_DARKGREY, COLOR_BLUE, COLOR_GREEN, COLOR_CYAN,
+	COLOR_RED, COLOR_MAGENTA, COLOR_YELLOW, COLOR_WHITE
+};
+
+/*
+ * Position and size of the console. Rows are kept as a ring, console_top is
+ * the row of console_char that is at the top of the console.
+ */
+int console_x = 0;
+int console_y = 0;
+int console_columns = 0;
+int console_rows = 0;
+int console_top = 0;
+int cursor_column = 0;
+int cursor_row = 0;
+int cursor_visible = 1;
+uint8_t current_attr = (CONSOLE_LIGHTGREY << 4) | CONSOLE_BLACK;
+
+/*
+ * Set when the console scrolls with the hardware scrolling. The rows of
+ * console_char then stay at the same place in display memory and the
+ * display moves them, so row n is always drawn at y + n * 13.
+ */
+int console_hardware = 0;
+
+/*
+ * Sets up a console at x, y (top left) with space for columns x rows
+ * characters and clears it.
+ * The console uses hardware scrolling when it starts at x = 0 and covers
+ * the width of the display in a portrait orientation. It then takes over
+ * the scrolling area, so call this again after set_rotation().
+ */
+void console_init(int x, int y, int columns, int rows) {
+	if(columns > CONSOLE_MAX_COLUMNS)
+		columns = CONSOLE_MAX_COLUMNS;
+	if(rows > CONSOLE_MAX_ROWS)
+		rows = CONSOLE_MAX_ROWS;
+	if(columns < 1)
+		columns = 1;
+	if(rows < 1)
+		rows = 1;
+
+	console_x = x;
+	console_y = y;
+	console_columns = columns;
+	console_rows = rows;
+	console_top = 0;
+	cursor_column = 0;
+	cursor_row = 0;
+
+	console_hardware = scroll_vertical() && x == 0 && y >= 0
+			&& (columns + 1) * CONSOLE_CHAR_WIDTH > lcd_width()
+			&& y + rows * CONSOLE_CHAR_HEIGHT <= lcd_height();
+	if(console_hardware)
+		set_scroll_area(y, lcd_height() - y - rows * CONSOLE_CHAR_HEIGHT);
+
+	console_clear();
+}
+
+/*
+ * Sets the colours used for the following text, as CONSOLE_ palette indexes
+ */
+void console_set_colour(int fg, int bg) {
+	current_attr = ((fg & 0x0F) << 4) | (bg & 0x0F);
+}
+
+/*
+ * Changes one of the 16 palette colours. Cells already using it are redrawn
+ * by the next console_update().
+ */
+void console_set_palette(int index, unsigned int colour) {
+	index &= 0x0F;
+	console_palette[index] = colour;
+
+	for(int i = 0; i < console_rows * console_columns; i++) {
+		if((shown_attr[i] >> 4) == index || (shown_attr[i] & 0x0F) == index)
+			shown_char[i] = 0;
+	}
+}
+
+/*
+ * Moves the cursor. The next character is written here.
+ */
+void console_set_cursor(int column, int row) {
+	if(column < 0)
+		column = 0;
+	if(column >= console_columns)
+		column = console_columns - 1;
+	if(row < 0)
+		row = 0;
+	if(row >= console_rows)
+		row = console_rows - 1;
+	cursor_column = column;
+	cursor_row = row;
+}
+
+/*
+ * Shows (1) or hides (0) the cursor, drawn as an inverted cell
+ */
+void console_show_cursor(int show) {
+	cursor_visible = show;
+}
+
+/*
+ * Index of the first cell of a console row, counted from the top
+ */
+int console_row_index(int row) {
+	return ((console_top + row) % console_rows) * console_columns;
+}
+
+/*
+ * Sets a row to spaces in the current colours
+ */
+void console_clear_row(int row) {
+	int i = console_row_index(row);
+	memset(&console_char[i], ' ', console_columns);
+	memset(&console_attr[i], current_attr, console_columns);
+}
+
+/*
+ * Moves the text up one row and clears the bottom row.
+ * With hardware scrolling everything already drawn is moved by the display
+ * and only the new row is cleared. Otherwise the rows are redrawn by
+ * console_update(), but only the cells that change.
+ */
+void console_scroll() {
+	int i;
+
+	//Draw what's waiting first so the text goes up with the rest
+	if(console_hardware)
+		console_update();
+
+	console_top = (console_top + 1) % console_rows;
+	console_clear_row(console_rows - 1);
+
+	if(console_hardware) {
+		//The new row is the same place in memory as the old top row
+		scroll_lines(CONSOLE_CHAR_HEIGHT, console_palette[current_attr & 0x0F]);
+		i = console_row_index(console_rows - 1);
+		memset(&shown_char[i], ' ', console_columns);
+		memset(&shown_attr[i], current_attr, console_columns);
+	}
+}
+
+/*
+ * Starts a new line, scrolling if the cursor is on the bottom row
+ */
+void console_newline() {
+	cursor_column = 0;
+	if(cursor_row < console_rows - 1)
+		cursor_row++;
+	else
+		console_scroll();
+}
+
+/*
+ * Writes a character at the cursor. Handles \n, \r, \t and \b, and wraps
+ * on to the next line at the right hand edge. Nothing is drawn until
+ * console_update().
+ */
+void console_putc(char c) {
+	int i;
+
+	if(console_rows == 0)
+		return;
+
+	switch(c) {
+	case '\n':
+		console_newline();
+		break;
+	case '\r':
+		cursor_column = 0;
+		break;
+	case '\b':
+		if(cursor_column > 0)
+			cursor_column--;
+		break;
+	case '\t':
+		do {
+			console_putc(' ');
+		} while(cursor_column % CONSOLE_TAB_SIZE != 0 && cursor_column < console_columns);
+		break;
+	default:
+		//The font only has the printable ASCII characters
+		if(c < 32 || c > 126)
+			c = '?';
+		//The line was full, so wrap
+		if(cursor_column >= console_columns)
+			console_newline();
+
+		i = console_row_index(cursor_row) + cursor_column;
+		console_char[i] = c;
+		console_attr[i] = current_attr;
+		cursor_column++;
+		break;
+	}
+}
+
+/*
+ * Writes a string and draws the changes
+ */
+void console_write(const char *str) {
+	while(*str != '\0')
+		console_putc(*str++);
+	console_update();
+}
+
+/*
+ * Clears the console to the background colour and moves the cursor to the
+ * top left.
+ */
+void console_clear() {
+	for(int row = 0; row < console_rows; row++)
+		console_clear_row(row);
+	cursor_column = 0;
+	cursor_row = 0;
+
+	//One fill is quicker than drawing every space
+	fill_rectangle(console_x, console_y, console_x + console_columns * CONSOLE_CHAR_WIDTH,
+			console_y + console_rows * CONSOLE_CHAR_HEIGHT, console_palette[current_attr & 0x0F]);
+	memset(shown_char, ' ', console_rows * console_columns);
+	memset(shown_attr, current_attr, console_rows * console_columns);
+}
+
+/*
+ * Draws every cell that has changed since it was last drawn
+ */
+void console_update() {
+	int row, column, index, screen_row, shown, x, y;
+	char c;
+	uint8_t attr;
+	unsigned int fg, bg;
+
+	lcd_begin_transaction();
+	for(row = 0; row < console_rows; row++) {
+		index = console_row_index(row);
+		//With hardware scrolling the rows don't move in memory
+		screen_row = console_hardware ? index / console_columns : row;
+		y = console_y + screen_row * CONSOLE_CHAR_HEIGHT;
+
+		for(column = 0; column < console_columns; column++, index++) {
+			c = console_char[index];
+			attr = console_attr[index];
+			if(cursor_visible && row == cursor_row && column == cursor_column)
+				c |= CURSOR_FLAG;
+
+			//shown_char and shown_attr are kept in screen order
+			shown = screen_row * console_columns + column;
+			if(shown_char[shown] == c && shown_attr[shown] == attr)
+				continue;
+
+			x = console_x + column * CONSOLE_CHAR_WIDTH;
+			fg = console_palette[attr >> 4];
+			bg = console_palette[attr & 0x0F];
+			if(c & CURSOR_FLAG)
+				draw_fast_char(x, y, c & ~CURSOR_FLAG, bg, fg);
+			else
+				draw_fast_char(x, y, c, fg, bg);
+
+			//The gap after the character only changes with the background
+			if(shown_char[shown] == 0 || (shown_attr[shown] & 0x0F) != (attr & 0x0F))
+				fill_rectangle(x + CONSOLE_CHAR_WIDTH - 1, y, x + CONSOLE_CHAR_WIDTH,
+						y + CONSOLE_CHAR_HEIGHT, bg);
+
+			shown_char[shown] = c;
+			shown_attr[shown] = attr;
+		}
+	}
+	lcd_end_transaction();
+}
+
+/*
+ * Draws every cell again, e.g. after something else has drawn over the
+ * console.
+ */
+void console_redraw() {
+	memset(shown_char, 0, console_rows * console_columns);
+	console_update();
+}
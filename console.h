@@ -0,0 +1,54 @@
+/*
+ * Scrolling text console for the ILI9488 driver
+ *
+ * File:   console.h
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+#ifndef CONSOLE_H
+#define	CONSOLE_H
+
+#include "ILI9488.h"
+
+//Size of each character cell. The font is 8 x 13 with a 1 pixel gap.
+#define CONSOLE_CHAR_WIDTH  9
+#define CONSOLE_CHAR_HEIGHT 13
+
+//Largest console in either orientation (480 / 9 and 480 / 13)
+#define CONSOLE_MAX_COLUMNS 53
+#define CONSOLE_MAX_ROWS    36
+
+#define CONSOLE_TAB_SIZE    4
+
+//Colours for console_set_colour(), indexes in to the console palette
+#define CONSOLE_BLACK       0
+#define CONSOLE_NAVY        1
+#define CONSOLE_DARKGREEN   2
+#define CONSOLE_DARKCYAN    3
+#define CONSOLE_DARKRED     4
+#define CONSOLE_INDIGO      5
+#define CONSOLE_OLIVE       6
+#define CONSOLE_LIGHTGREY   7
+#define CONSOLE_DARKGREY    8
+#define CONSOLE_BLUE        9
+#define CONSOLE_GREEN       10
+#define CONSOLE_CYAN        11
+#define CONSOLE_RED         12
+#define CONSOLE_MAGENTA     13
+#define CONSOLE_YELLOW      14
+#define CONSOLE_WHITE       15
+
+void console_init(int x, int y, int columns, int rows);
+void console_set_colour(int fg, int bg);
+void console_set_palette(int index, unsigned int colour);
+void console_set_cursor(int column, int row);
+void console_show_cursor(int show);
+void console_putc(char c);
+void console_write(const char *str);
+void console_clear();
+void console_update();
+void console_redraw();
+
+#endif	/* CONSOLE_H */
@@ -5,7 +5,7 @@ from PIL import Image
 import struct, os, sys
 
 def usage():
-    print("./png2rgb565.py HOGE.png")
+    print("./png2rgb565.py HOGE.png [--qoi | --raw]")
     sys.exit(1)
     
 def error(msg):
@@ -25,9 +25,69 @@ def write_bin(f, pixel_list):
             f.write('\n')
             counter = 0
 
+def write_raw(f, pixel_list):
+    # Binary RGB565, low byte first, for draw_bitmap_stream()
+    for pix in pixel_list:
+        r = (pix[0] >> 3) & 0x1F
+        g = (pix[1] >> 2) & 0x3F
+        b = (pix[2] >> 3) & 0x1F
+        f.write(struct.pack('<H', (r << 11) + (g << 5) + b))
+
+def write_qoi(f, width, height, pixel_list):
+    # Encodes the image as QOI (qoiformat.org) for draw_qoi(). The spec
+    # compares and hashes RGBA pixels, starting from an index of (0,0,0,0)
+    # and a previous pixel of (0,0,0,255), so RGB pixels get alpha 255.
+    out = bytearray(b'qoif' + struct.pack('>IIBB', width, height, 3, 0))
+    index = [(0, 0, 0, 0)] * 64
+    prev = (0, 0, 0, 255)
+    run = 0
+    for i, pix in enumerate(pixel_list):
+        pix = tuple(pix[:4]) if len(pix) > 3 else tuple(pix[:3]) + (255,)
+        if pix == prev:
+            run = run + 1
+            if run == 62 or i == len(pixel_list) - 1:
+                out.append(0xC0 | (run - 1))
+                run = 0
+            continue
+        if run:
+            out.append(0xC0 | (run - 1))
+            run = 0
+        h = (pix[0] * 3 + pix[1] * 5 + pix[2] * 7 + pix[3] * 11) % 64
+        if index[h] == pix:
+            out.append(h)
+        elif pix[3] != prev[3]:
+            index[h] = pix
+            out.extend([0xFF, pix[0], pix[1], pix[2], pix[3]])
+        else:
+            index[h] = pix
+            vr = (pix[0] - prev[0] + 128) % 256 - 128
+            vg = (pix[1] - prev[1] + 128) % 256 - 128
+            vb = (pix[2] - prev[2] + 128) % 256 - 128
+            if -3 < vr < 2 and -3 < vg < 2 and -3 < vb < 2:
+                out.append(0x40 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2))
+            elif -9 < vr - vg < 8 and -33 < vg < 32 and -9 < vb - vg < 8:
+                out.append(0x80 | (vg + 32))
+                out.append((vr - vg + 8) << 4 | (vb - vg + 8))
+            else:
+                out.extend([0xFE, pix[0], pix[1], pix[2]])
+        prev = pix
+    out.extend([0, 0, 0, 0, 0, 0, 0, 1])
+
+    counter = 0
+    for byte in out:
+        counter = counter + 1
+        f.write(hex(byte)+", ")
+        if(counter == 32):
+            f.write('\n')
+            counter = 0
+
 ##
 if __name__ == '__main__':
     args = sys.argv
+    qoi = '--qoi' in args
+    if qoi: args.remove('--qoi')
+    raw = '--raw' in args
+    if raw: args.remove('--raw')
     if len(args) != 2: usage()
     in_path = args[1]
     if os.path.exists(in_path) == False: error('not exists: ' + in_path)
@@ -39,5 +99,13 @@ if __name__ == '__main__':
     pixels = list(img.getdata())
     # print pixels
     
+    if raw:
+        with open(body + '.raw', 'wb') as f:
+            write_raw(f, pixels)
+        sys.exit(0)
+
     with open(out_path, 'w') as f:
-        write_bin(f, pixels)
\ No newline at end of file
+        if qoi:
+            write_qoi(f, img.width, img.height, pixels)
+        else:
+            write_bin(f, pixels)
\ No newline at end of file
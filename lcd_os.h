@@ -0,0 +1,37 @@
+/*
+ * Operating system hooks for the ILI9488 driver
+ *
+ * File:   lcd_os.h
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+#ifndef LCD_OS_H
+#define	LCD_OS_H
+
+#include "ILI9488.h"
+
+/*
+ * The driver waits for DMA and shares the display between tasks through
+ * these. One implementation is picked with LCD_OS in ILI9488.h and the
+ * others compile to nothing.
+ *
+ *  os_none.c    - Bare metal, waits spin on the DMA flag
+ *  os_cmsis.c   - CMSIS-RTOS2, a semaphore for each display and one mutex
+ *  os_pthread.c - POSIX threads, for testing on a PC
+ *
+ * lcd_os_wait() returns once the display's DMA transfer is done, letting
+ * other tasks run in the meantime. The DMA completion interrupt clears
+ * dma_transfer_in_progress and then calls lcd_os_signal(), so that has to
+ * be safe in an interrupt. lcd_os_lock() and lcd_os_unlock() make tasks
+ * take turns with the driver, and can be nested. Every drawing function
+ * takes the lock while it runs.
+ */
+void lcd_os_init(lcd_display *display);
+void lcd_os_wait(lcd_display *display);
+void lcd_os_signal(lcd_display *display);
+void lcd_os_lock();
+void lcd_os_unlock();
+
+#endif	/* LCD_OS_H */
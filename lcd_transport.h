@@ -0,0 +1,118 @@
+/*
+ * Bus transport for the ILI9488 driver
+ *
+ * File:   lcd_transport.h
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+#ifndef LCD_TRANSPORT_H
+#define	LCD_TRANSPORT_H
+
+#include "ILI9488.h"
+#include "lcd_os.h"
+
+/*
+ * Everything ILI9488.c sends to the display goes through these functions.
+ * One backend is picked with LCD_TRANSPORT in ILI9488.h and the others
+ * compile to nothing, so they are plain function calls with no pointers in
+ * between. Pixel data is always passed as whole buffers, never a byte at a
+ * time. Parameters are bytes, pixels are PIXEL_BYTES each, which on a
+ * parallel bus is one native 16-bit word per pixel.
+ *
+ *  transport_spi_hal.c - STM32 HAL SPI, DMA for pixel data
+ *  transport_spi_ll.c  - SPI and GPIO registers written directly, DMA for pixel data
+ *  transport_spi_regs.c - Register level SPI writes used by both SPI backends
+ *  transport_parallel.c - 16-bit 8080 bus with GPIO pins, no DMA
+ *  transport_fsmc.c    - 16-bit 8080 bus on the FSMC / FMC, memory to memory DMA for pixel data
+ *  transport_host.c    - Host mock with an emulated display memory, for testing
+ */
+
+/*
+ * Bytes sent through the transport since the last transport_reset_stats().
+ */
+typedef struct {
+	uint32_t commands;		//Command bytes
+	uint32_t data_bytes;	//Parameter and pixel bytes
+	uint32_t transfers;		//Blocking writes, one per call
+	uint32_t dma_transfers;	//DMA transfers started
+	uint32_t selects;		//Times CS was pulled low
+} transport_stats;
+
+extern transport_stats lcd_transport_stats;
+
+/*
+ * Most items (bytes, or half words for 16-bit transfers) one DMA transfer
+ * can move, as the channel's count register is 16 bits. transport_write_dma()
+ * takes any length and sends longer buffers in pieces of up to this many,
+ * each one started from the completion interrupt of the last.
+ * Its buffer isn't const: a backend can change it while it is sent, as
+ * transport_spi_ll.c does with SPI_16BIT_FRAMES, so only the driver's own
+ * buffers are passed to it.
+ */
+#define TRANSPORT_DMA_MAX 65535
+
+void transport_init();
+void transport_reset(int level);
+void transport_command(uint8_t command);
+void transport_data(const uint8_t *data, unsigned int len);
+void transport_begin_data();
+void transport_write(const uint8_t *data, unsigned int len);
+void transport_write_dma(uint8_t *data, unsigned int len);
+void transport_wait();
+void transport_end();
+void transport_begin_transaction();
+void transport_end_transaction();
+void transport_delay(uint32_t ms);
+uint32_t transport_ticks();
+void transport_reset_stats();
+
+#if LCD_TRANSPORT == LCD_TRANSPORT_SPI_HAL || LCD_TRANSPORT == LCD_TRANSPORT_SPI_LL
+//Shared by both SPI backends, see transport_spi_regs.c
+#if SPI_16BIT_FRAMES
+void spi_frame_size(SPI_TypeDef *spi, int bits);
+#endif
+void spi_drain(SPI_TypeDef *spi);
+void spi_write_registers(SPI_TypeDef *spi, const uint8_t *data, unsigned int len);
+#endif
+
+#if LCD_HOST
+//Host mock, see transport_host.c
+
+/*
+ * Emulated display. Memory is 320 x 480 with 3 bytes per pixel (the top 5
+ * or 6 bits of each are used) in the panel's own order. Each lcd_display
+ * has its own, lcd_default uses host_default_panel.
+ */
+struct host_panel {
+	uint8_t gram[ILI9488_TFTHEIGHT][ILI9488_TFTWIDTH][3];
+	uint8_t madctl;
+	uint8_t colmod;
+	uint16_t column_start, column_end, page_start, page_end;
+	uint16_t column, page;
+	uint16_t scroll_top;
+	uint16_t scroll_size;
+	uint16_t scroll_start;
+	uint8_t selected;
+	uint8_t reset;
+
+	uint8_t command;
+	uint8_t params[16];
+	unsigned int param_count;
+	uint8_t pixel_data[3];
+	unsigned int pixel_count;
+};
+
+extern struct host_panel host_default_panel;
+extern uint32_t host_cycle_ns, host_call_ns, host_dma_ns, host_select_ns;
+extern uint64_t host_time_ns, host_cycles;
+extern uint32_t host_errors;
+extern volatile uint8_t host_dma_async;
+int host_dma_complete(lcd_display *display);
+uint32_t host_pixel(int x, int y);
+uint32_t host_panel_pixel(struct host_panel *panel, int x, int y);
+uint32_t host_colour(unsigned int colour);
+#endif
+
+#endif	/* LCD_TRANSPORT_H */
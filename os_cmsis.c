@@ -0,0 +1,80 @@
+/*
+ * CMSIS-RTOS2 hooks for the ILI9488 driver, for FreeRTOS (or any other
+ * RTOS with the CMSIS-RTOS2 API) as set up by CubeMX.
+ *
+ * Each display has a binary semaphore that its DMA completion interrupt
+ * releases, so a task waiting for a transfer sleeps instead of spinning.
+ * One recursive mutex, with priority inheritance, is shared by all the
+ * displays since lcd (the selected display) is shared too.
+ *
+ * lcd_init() can be called before osKernelStart(). Until the kernel is
+ * running the waits spin and the lock does nothing, like os_none.c. An
+ * unlock only releases the mutex if its lock really took it.
+ *
+ * File:   os_cmsis.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "lcd_os.h"
+
+#if LCD_OS == LCD_OS_CMSIS
+
+osMutexId_t lcd_os_mutex = NULL;
+
+//How many of the owner's nested locks took the mutex. It is kept with the
+//mutex, not a display, as lcd_unlock() can run with another display
+//selected. Only the task holding the mutex changes it.
+uint32_t lcd_os_taken = 0;
+
+/*
+ * Makes the mutex the first time and the display's semaphore. Call from a
+ * task or before the kernel starts, not from an interrupt.
+ */
+void lcd_os_init(lcd_display *display) {
+	const osMutexAttr_t mutex_attr = {
+		.name = "lcd",
+		.attr_bits = osMutexRecursive | osMutexPrioInherit,
+	};
+
+	if(!lcd_os_mutex)
+		lcd_os_mutex = osMutexNew(&mutex_attr);
+	if(!display->dma_done)
+		display->dma_done = osSemaphoreNew(1, 0, NULL);
+}
+
+/*
+ * The semaphore can be left over from a transfer nobody waited for, so
+ * the flag is checked again each time it is taken.
+ */
+void lcd_os_wait(lcd_display *display) {
+	while(display->dma_transfer_in_progress) {
+		if(osKernelGetState() == osKernelRunning)
+			osSemaphoreAcquire(display->dma_done, osWaitForever);
+	}
+}
+
+void lcd_os_signal(lcd_display *display) {
+	if(display->dma_done)
+		osSemaphoreRelease(display->dma_done);
+}
+
+void lcd_os_lock() {
+	if(osKernelGetState() == osKernelRunning && osMutexAcquire(lcd_os_mutex, osWaitForever) == osOK)
+		lcd_os_taken++;
+}
+
+/*
+ * Whether the kernel is running now doesn't matter, only whether the lock
+ * this matches took the mutex
+ */
+void lcd_os_unlock() {
+	if(lcd_os_taken) {
+		lcd_os_taken--;
+		osMutexRelease(lcd_os_mutex);
+	}
+}
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ * Bare metal hooks for the ILI9488 driver. There are no other tasks to
+ * run, so waiting for DMA spins on the flag and locking does nothing.
+ *
+ * File:   os_none.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "lcd_os.h"
+
+#if LCD_OS == LCD_OS_NONE
+
+void lcd_os_init(lcd_display *display) {
+}
+
+void lcd_os_wait(lcd_display *display) {
+	while(display->dma_transfer_in_progress);
+}
+
+void lcd_os_signal(lcd_display *display) {
+}
+
+void lcd_os_lock() {
+}
+
+void lcd_os_unlock() {
+}
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ * POSIX threads hooks for the ILI9488 driver, so the waiting and locking
+ * can be tested on a PC with the host transport. The DMA interrupt is
+ * played by another thread that clears the flag and calls lcd_os_signal().
+ *
+ * File:   os_pthread.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "lcd_os.h"
+
+#if LCD_OS == LCD_OS_PTHREAD
+
+pthread_mutex_t lcd_os_mutex;
+pthread_once_t lcd_os_once = PTHREAD_ONCE_INIT;
+
+void lcd_os_create_mutex() {
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&lcd_os_mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+void lcd_os_init(lcd_display *display) {
+	pthread_once(&lcd_os_once, lcd_os_create_mutex);
+	if(!display->dma_ready) {
+		pthread_mutex_init(&display->dma_mutex, NULL);
+		pthread_cond_init(&display->dma_done, NULL);
+		display->dma_ready = 1;
+	}
+}
+
+void lcd_os_wait(lcd_display *display) {
+	pthread_mutex_lock(&display->dma_mutex);
+	while(display->dma_transfer_in_progress)
+		pthread_cond_wait(&display->dma_done, &display->dma_mutex);
+	pthread_mutex_unlock(&display->dma_mutex);
+}
+
+/*
+ * Taking the mutex means the signal can't land between a waiter checking
+ * the flag and going to sleep
+ */
+void lcd_os_signal(lcd_display *display) {
+	pthread_mutex_lock(&display->dma_mutex);
+	pthread_cond_broadcast(&display->dma_done);
+	pthread_mutex_unlock(&display->dma_mutex);
+}
+
+void lcd_os_lock() {
+	pthread_mutex_lock(&lcd_os_mutex);
+}
+
+void lcd_os_unlock() {
+	pthread_mutex_unlock(&lcd_os_mutex);
+}
+
+#endif
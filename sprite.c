@@ -0,0 +1,243 @@
+/*
+ * Sprites drawn over a background for the ILI9488.
+ *
+ * sprite_update() works out which areas have changed since the last frame
+ * (where each sprite was and where it is now), joins the ones that overlap,
+ * and draws each area once. The rows of an area are put together from the
+ * background and every sprite over it before they are sent, so nothing
+ * flickers, and the rest of the screen isn't sent at all.
+ *
+ * File:   sprite.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "sprite.h"
+#include "lcd_os.h"
+
+//Old and new area of every sprite, and areas left by removed sprites
+#define SPRITE_REGIONS (SPRITE_MAX * 3)
+
+typedef struct {
+	int x1, y1, x2, y2;
+} sprite_region;
+
+sprite *sprites[SPRITE_MAX];
+int sprite_count = 0;
+
+sprite_region regions[SPRITE_REGIONS];
+int region_count = 0;
+
+/*
+ * Background the sprites are drawn over, a bitmap at background_x,
+ * background_y with background_colour everywhere else.
+ */
+const unsigned int *background = 0;
+int background_x = 0;
+int background_y = 0;
+unsigned int background_colour = COLOR_BLACK;
+
+//One row of an area being put together
+unsigned int sprite_line[ILI9488_TFTHEIGHT];
+
+/*
+ * Sets what is behind the sprites. bmp can be 0 for just a colour.
+ * This doesn't draw anything, use sprite_redraw_area() for that.
+ */
+void sprite_set_background(const unsigned int *bmp, int x, int y, unsigned int colour) {
+	background = bmp;
+	background_x = x;
+	background_y = y;
+	background_colour = colour;
+}
+
+/*
+ * Adds the area x1, y1 to x2, y2 (exclusive) to be redrawn
+ */
+void add_region(int x1, int y1, int x2, int y2) {
+	if(x2 <= x1 || y2 <= y1)
+		return;
+
+	//Out of space, so grow the first region to cover it
+	if(region_count >= SPRITE_REGIONS) {
+		if(x1 < regions[0].x1)
+			regions[0].x1 = x1;
+		if(y1 < regions[0].y1)
+			regions[0].y1 = y1;
+		if(x2 > regions[0].x2)
+			regions[0].x2 = x2;
+		if(y2 > regions[0].y2)
+			regions[0].y2 = y2;
+		return;
+	}
+	regions[region_count].x1 = x1;
+	regions[region_count].y1 = y1;
+	regions[region_count].x2 = x2;
+	regions[region_count].y2 = y2;
+	region_count++;
+}
+
+/*
+ * Adds a sprite at x, y. It is drawn on the next sprite_update(), on top
+ * of the sprites added before it. Returns -1 if there are too many.
+ */
+int sprite_add(sprite *s, const unsigned int *bmp, int x, int y) {
+	if(sprite_count >= SPRITE_MAX)
+		return -1;
+	s->bmp = bmp;
+	s->x = x;
+	s->y = y;
+	s->visible = 1;
+	s->drawn = 0;
+	sprites[sprite_count++] = s;
+	return 0;
+}
+
+/*
+ * Takes a sprite away. The background is put back on the next
+ * sprite_update().
+ */
+void sprite_remove(sprite *s) {
+	for(int i = 0; i < sprite_count; i++) {
+		if(sprites[i] != s)
+			continue;
+		if(s->drawn)
+			add_region(s->drawn_x, s->drawn_y, s->drawn_x + s->drawn_w, s->drawn_y + s->drawn_h);
+		for(; i < sprite_count - 1; i++)
+			sprites[i] = sprites[i + 1];
+		sprite_count--;
+		return;
+	}
+}
+
+/*
+ * Joins regions that overlap or touch, so no pixel is sent twice
+ */
+void merge_regions() {
+	int i, j, merged;
+
+	do {
+		merged = 0;
+		for(i = 0; i < region_count; i++) {
+			for(j = i + 1; j < region_count; j++) {
+				if(regions[j].x1 > regions[i].x2 || regions[j].x2 < regions[i].x1
+						|| regions[j].y1 > regions[i].y2 || regions[j].y2 < regions[i].y1)
+					continue;
+
+				if(regions[j].x1 < regions[i].x1)
+					regions[i].x1 = regions[j].x1;
+				if(regions[j].y1 < regions[i].y1)
+					regions[i].y1 = regions[j].y1;
+				if(regions[j].x2 > regions[i].x2)
+					regions[i].x2 = regions[j].x2;
+				if(regions[j].y2 > regions[i].y2)
+					regions[i].y2 = regions[j].y2;
+
+				regions[j] = regions[--region_count];
+				merged = 1;
+				j--;
+			}
+		}
+	} while(merged);
+}
+
+/*
+ * Draws the area x1, y1 to x2, y2 (exclusive) from the background and the
+ * sprites over it, as one window.
+ */
+void sprite_redraw_area(int x1, int y1, int x2, int y2) {
+	const unsigned int *row;
+	unsigned int px;
+	int x, y, i, width, height, start, end;
+	sprite *s;
+
+	//Held from the clipping on, so no other task changes the clip rectangle
+	lcd_os_lock();
+	if(!clip_rect(&x1, &y1, &x2, &y2)) {
+		lcd_os_unlock();
+		return;
+	}
+
+	begin_pixels(x1, y1, x2, y2);
+
+	for(y = y1; y < y2; y++) {
+		//Background first
+		for(x = x1; x < x2; x++)
+			sprite_line[x - x1] = background_colour;
+		if(background && y >= background_y && y < background_y + (int)background[1]) {
+			width = background[0];
+			row = background + 2 + ((y - background_y) * width);
+			start = (x1 > background_x) ? x1 : background_x;
+			end = (x2 < background_x + width) ? x2 : background_x + width;
+			for(x = start; x < end; x++)
+				sprite_line[x - x1] = row[x - background_x];
+		}
+
+		//Then each sprite on this row, in order
+		for(i = 0; i < sprite_count; i++) {
+			s = sprites[i];
+			if(!s->visible)
+				continue;
+			width = s->bmp[0];
+			height = s->bmp[1];
+			if(y < s->y || y >= s->y + height || s->x >= x2 || s->x + width <= x1)
+				continue;
+
+			row = s->bmp + 2 + ((y - s->y) * width);
+			start = (x1 > s->x) ? x1 : s->x;
+			end = (x2 < s->x + width) ? x2 : s->x + width;
+			for(x = start; x < end; x++) {
+				px = row[x - s->x];
+				if(px != SPRITE_TRANSPARENT)
+					sprite_line[x - x1] = px;
+			}
+		}
+
+		write_pixels(sprite_line, x2 - x1);
+	}
+
+	end_pixels();
+	lcd_os_unlock();
+}
+
+/*
+ * Draws everything that has changed since the last call: each sprite that
+ * moved, changed bitmap or was hidden is cleared from where it was and drawn
+ * where it is now. Overlapping areas are joined and each is sent once.
+ */
+void sprite_update() {
+	int i, width, height;
+	sprite *s;
+
+	for(i = 0; i < sprite_count; i++) {
+		s = sprites[i];
+		width = s->visible ? (int)s->bmp[0] : 0;
+		height = s->visible ? (int)s->bmp[1] : 0;
+
+		//Nothing changed
+		if(s->drawn == s->visible && (!s->visible || (s->x == s->drawn_x && s->y == s->drawn_y
+				&& s->bmp == s->drawn_bmp)))
+			continue;
+
+		if(s->drawn)
+			add_region(s->drawn_x, s->drawn_y, s->drawn_x + s->drawn_w, s->drawn_y + s->drawn_h);
+		if(s->visible)
+			add_region(s->x, s->y, s->x + width, s->y + height);
+
+		s->drawn = s->visible;
+		s->drawn_bmp = s->bmp;
+		s->drawn_x = s->x;
+		s->drawn_y = s->y;
+		s->drawn_w = width;
+		s->drawn_h = height;
+	}
+
+	merge_regions();
+	lcd_begin_transaction();
+	for(i = 0; i < region_count; i++)
+		sprite_redraw_area(regions[i].x1, regions[i].y1, regions[i].x2, regions[i].y2);
+	lcd_end_transaction();
+	region_count = 0;
+}
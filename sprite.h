@@ -0,0 +1,38 @@
+/*
+ * Sprites drawn over a background for the ILI9488
+ *
+ * File:   sprite.h
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+#ifndef SPRITE_H
+#define	SPRITE_H
+
+#include "ILI9488.h"
+
+#define SPRITE_MAX          16 //Number of sprites that can be added
+#define SPRITE_TRANSPARENT  COLOR_MAGENTA //Sprite pixels this colour aren't drawn
+
+/*
+ * A sprite uses a bitmap in the same format as draw_bitmap(). Change x, y,
+ * bmp and visible as needed, then call sprite_update() once per frame.
+ */
+typedef struct {
+	const unsigned int *bmp;
+	int x, y;
+	int visible;
+	//Where it was last drawn
+	int drawn;
+	const unsigned int *drawn_bmp;
+	int drawn_x, drawn_y, drawn_w, drawn_h;
+} sprite;
+
+void sprite_set_background(const unsigned int *bmp, int x, int y, unsigned int colour);
+int sprite_add(sprite *s, const unsigned int *bmp, int x, int y);
+void sprite_remove(sprite *s);
+void sprite_update();
+void sprite_redraw_area(int x1, int y1, int x2, int y2);
+
+#endif	/* SPRITE_H */
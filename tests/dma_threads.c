@@ -0,0 +1,94 @@
+/*
+ * Tests the waiting and locking of os_pthread.c on the host mock. DMA is
+ * left running (host_dma_async) and a thread plays the DMA interrupt,
+ * finishing each transfer a little later. Two threads draw at the same
+ * time without lcd_lock(), each on its own part of the display, and the
+ * result is checked against the same drawing done by one thread.
+ *
+ * File:   dma_threads.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "ILI9488.h"
+#include "lcd_transport.h"
+#include "sprite.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define LOOPS 50
+
+static unsigned int bitmap[2 + 40 * 30];
+static uint32_t reference[ILI9488_TFTHEIGHT][ILI9488_TFTWIDTH];
+static volatile int stop = 0;
+static int transfers = 0;
+
+/*
+ * The DMA interrupt. Each transfer takes a little while to finish.
+ */
+static void *dma_interrupt(void *arg) {
+	while(!stop) {
+		usleep(20);
+		transfers += host_dma_complete(&lcd_default);
+	}
+	return NULL;
+}
+
+/*
+ * Two different drawings, each with its own part of the display
+ */
+static void *draw(void *arg) {
+	int which = (int)(intptr_t)arg;
+
+	for(int i = 0; i < LOOPS; i++) {
+		if(which) {
+			draw_bitmap(240, 20, 2, bitmap);
+			draw_bitmap_scaled(250, 200, 100, 70, bitmap, SCALE_BILINEAR);
+			sprite_redraw_area(380, 20, 460, 100);
+		} else {
+			fill_rectangle(0, 0, 200, 150, i & 1 ? COLOR_GREEN : COLOR_RED);
+			draw_fast_string(10, 200, COLOR_WHITE, COLOR_BLUE, "Two threads");
+		}
+	}
+	return NULL;
+}
+
+int main() {
+	pthread_t interrupt, threads[2];
+	int wrong = 0;
+
+	bitmap[0] = 40;
+	bitmap[1] = 30;
+	for(int i = 0; i < 40 * 30; i++)
+		bitmap[2 + i] = (i * 2654435761u) >> 16;
+
+	lcd_init();
+	set_rotation(1);
+	sprite_set_background(bitmap, 390, 30, COLOR_YELLOW);
+
+	//What it should look like, drawn by one thread with DMA finishing at once
+	draw((void *)0);
+	draw((void *)1);
+	for(int y = 0; y < ILI9488_TFTHEIGHT; y++)
+		for(int x = 0; x < ILI9488_TFTWIDTH; x++)
+			reference[y][x] = host_panel_pixel(&host_default_panel, x, y);
+	clear_screen(0);
+
+	host_dma_async = 1;
+	pthread_create(&interrupt, NULL, dma_interrupt, NULL);
+	for(int i = 0; i < 2; i++)
+		pthread_create(&threads[i], NULL, draw, (void *)(intptr_t)i);
+	for(int i = 0; i < 2; i++)
+		pthread_join(threads[i], NULL);
+	stop = 1;
+	pthread_join(interrupt, NULL);
+
+	for(int y = 0; y < ILI9488_TFTHEIGHT; y++)
+		for(int x = 0; x < ILI9488_TFTWIDTH; x++)
+			wrong += host_panel_pixel(&host_default_panel, x, y) != reference[y][x];
+
+	printf("%d transfers finished by the interrupt thread, %d pixels wrong, %u errors\n", transfers, wrong, host_errors);
+	return (transfers > 0 && wrong == 0 && host_errors == 0) ? 0 : 1;
+}
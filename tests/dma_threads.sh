@@ -0,0 +1,18 @@
+#!/bin/sh
+# Two drawing threads and a thread playing the DMA interrupt, on the host
+# mock with os_pthread.c. See dma_threads.c. Needs gcc and POSIX threads.
+#
+# File:   dma_threads.sh
+# Author: tommy
+#
+# Created on 19th October 2026
+
+set -e
+REPO=$(cd "$(dirname "$0")/.." && pwd)
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+gcc -std=gnu99 -Wall -DLCD_TRANSPORT=LCD_TRANSPORT_HOST -DLCD_OS=LCD_OS_PTHREAD -I"$REPO" \
+	-o "$OUT/dma_threads" "$REPO/tests/dma_threads.c" "$REPO/ILI9488.c" \
+	"$REPO/transport_host.c" "$REPO/os_pthread.c" "$REPO/sprite.c" -lm -lpthread
+"$OUT/dma_threads"
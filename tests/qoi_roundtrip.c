@@ -0,0 +1,48 @@
+/*
+ * Draws the image that qoi_roundtrip.sh encoded with img2hex.py --qoi and
+ * checks that draw_qoi() gives back every pixel of the source image. The
+ * source is drawn first with draw_pixels() (on the host mock a pixel is
+ * the same R, G, B bytes) and the whole panel memory is compared, so the
+ * check doesn't depend on where the rotation puts the image.
+ *
+ * File:   qoi_roundtrip.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "ILI9488.h"
+#include "lcd_transport.h"
+#include "expected.h"
+#include <stdio.h>
+
+static const uint8_t image[] = {
+#include "image.bin"
+};
+
+static uint32_t reference[ILI9488_TFTHEIGHT][ILI9488_TFTWIDTH];
+
+int main() {
+	lcd_memory_source src = { image, sizeof(image) };
+	int wrong = 0;
+	int result;
+
+	lcd_init();
+	set_rotation(1);
+
+	draw_pixels(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT, expected);
+	for(int y = 0; y < ILI9488_TFTHEIGHT; y++)
+		for(int x = 0; x < ILI9488_TFTWIDTH; x++)
+			reference[y][x] = host_pixel(x, y);
+
+	fill_rectangle(0, 0, IMAGE_WIDTH, IMAGE_HEIGHT, COLOR_MAGENTA);
+	result = draw_qoi(0, 0, lcd_read_memory, &src);
+
+	for(int y = 0; y < ILI9488_TFTHEIGHT; y++)
+		for(int x = 0; x < ILI9488_TFTWIDTH; x++)
+			wrong += host_pixel(x, y) != reference[y][x];
+
+	printf("draw_qoi %d, %d pixels wrong\n", result, wrong);
+	return (result == 0 && wrong == 0 && host_errors == 0) ? 0 : 1;
+}
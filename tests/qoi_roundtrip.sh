@@ -0,0 +1,50 @@
+#!/bin/sh
+# Round trip test for img2hex.py --qoi and draw_qoi(). A test image is
+# encoded with the script, drawn with draw_qoi() on the host mock transport
+# and checked pixel by pixel. Needs gcc and Python 3 with Pillow.
+#
+# File:   qoi_roundtrip.sh
+# Author: tommy
+#
+# Created on 19th October 2026
+
+set -e
+REPO=$(cd "$(dirname "$0")/.." && pwd)
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+# Runs of colours that come back around (the index), small and medium steps
+# (diff and luma), long runs and noise (full RGB)
+python3 - "$OUT" <<'PY'
+import sys, random
+from PIL import Image
+out = sys.argv[1]
+w, h = 64, 32
+pattern = [(255, 0, 0), (0, 0, 0), (0, 255, 0), (0, 0, 255), (0, 255, 0)]
+rng = random.Random(1)
+pixels = []
+for y in range(h):
+    for x in range(w):
+        if y < 8:
+            pixels.append(pattern[(y * w + x) % len(pattern)])
+        elif y < 16:
+            pixels.append((x * 4, y * 8, 255 - x * 4))
+        elif y < 20:
+            pixels.append((0, 0, 0) if x < 40 else (255, 255, 255))
+        else:
+            pixels.append(tuple(rng.randrange(256) for c in range(3)))
+img = Image.new('RGB', (w, h))
+img.putdata(pixels)
+img.save(out + '/image.png')
+with open(out + '/expected.h', 'w') as f:
+    f.write('#define IMAGE_WIDTH %d\n#define IMAGE_HEIGHT %d\n' % (w, h))
+    f.write('static uint8_t expected[] = {\n')
+    f.write(',\n'.join('%d, %d, %d' % p for p in pixels))
+    f.write('\n};\n')
+PY
+
+python3 "$REPO/img2hex.py" --qoi "$OUT/image.png"
+gcc -std=gnu99 -Wall -DLCD_TRANSPORT=LCD_TRANSPORT_HOST -I"$REPO" -I"$OUT" \
+	-o "$OUT/qoi_roundtrip" "$REPO/tests/qoi_roundtrip.c" "$REPO/ILI9488.c" \
+	"$REPO/transport_host.c" "$REPO/os_none.c" -lm
+"$OUT/qoi_roundtrip"
@@ -0,0 +1,150 @@
+/*
+ * Tile map drawing for the ILI9488.
+ *
+ * The map remembers which tile was last drawn in each cell and only sends
+ * cells that have changed. Changed cells next to each other on a row are
+ * sent as one window, with the pixels read straight out of the atlas.
+ *
+ * File:   tilemap.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "tilemap.h"
+
+//shown value for a cell that has to be drawn whatever is in the map
+#define TILE_UNKNOWN 0xFFFF
+
+/*
+ * Sets up a map of columns x rows tiles with its top left corner at x, y.
+ * Nothing is drawn until tilemap_update(), which draws every cell the
+ * first time. Sizes below 1 are taken as 1, and tiles bigger than the
+ * atlas are cut down to its size.
+ */
+void tilemap_init(tilemap *tm, int x, int y, int columns, int rows, int tile_width, int tile_height,
+		const unsigned int *atlas, const uint8_t *map) {
+	if(columns < 1)
+		columns = 1;
+	if(rows < 1)
+		rows = 1;
+	if(tile_width < 1)
+		tile_width = 1;
+	if(tile_height < 1)
+		tile_height = 1;
+	if(atlas[0] && tile_width > (int)atlas[0])
+		tile_width = atlas[0];
+	if(atlas[1] && tile_height > (int)atlas[1])
+		tile_height = atlas[1];
+	if(columns > TILEMAP_MAX_CELLS)
+		columns = TILEMAP_MAX_CELLS;
+	if(columns * rows > TILEMAP_MAX_CELLS)
+		rows = TILEMAP_MAX_CELLS / columns;
+
+	tm->x = x;
+	tm->y = y;
+	tm->columns = columns;
+	tm->rows = rows;
+	tm->tile_width = tile_width;
+	tm->tile_height = tile_height;
+	tm->atlas = atlas;
+	tm->map = map;
+	tm->atlas_columns = atlas[0] / tile_width;
+	tm->tiles = tm->atlas_columns * (atlas[1] / tile_height);
+	tilemap_invalidate(tm);
+}
+
+/*
+ * Draws every cell on the next tilemap_update(), e.g. after something else
+ * has drawn over the map.
+ */
+void tilemap_invalidate(tilemap *tm) {
+	for(int i = 0; i < tm->columns * tm->rows; i++)
+		tm->shown[i] = TILE_UNKNOWN;
+}
+
+/*
+ * Sends the cells first to last - 1 of a row as one window. Each line of
+ * pixels is sent a tile at a time from the atlas. A tile past the end of
+ * the atlas is drawn in TILEMAP_BACKGROUND.
+ */
+void draw_tile_run(tilemap *tm, int row, int first, int last) {
+	const unsigned int background = TILEMAP_BACKGROUND;
+	int atlas_width = tm->atlas[0];
+	int atlas_columns = tm->atlas_columns;
+	const uint8_t *cells = tm->map + (row * tm->columns);
+	const unsigned int *src;
+	int x1 = tm->x + (first * tm->tile_width);
+	int top = tm->y + (row * tm->tile_height);
+	int y1 = top;
+	int x2 = tm->x + (last * tm->tile_width);
+	int y2 = top + tm->tile_height;
+	int line, cell, cx1, cx2, tile;
+
+	//Only the visible part of the run is sent
+	if(!clip_rect(&x1, &y1, &x2, &y2))
+		return;
+
+	begin_pixels(x1, y1, x2, y2);
+	for(line = y1 - top; line < y2 - top; line++) {
+		for(cell = first; cell < last; cell++) {
+			//Visible columns of this cell
+			cx1 = tm->x + (cell * tm->tile_width);
+			cx2 = cx1 + tm->tile_width;
+			if(cx2 <= x1 || cx1 >= x2)
+				continue;
+
+			tile = cells[cell];
+			if(tile >= tm->tiles) {
+				if(cx1 < x1)
+					cx1 = x1;
+				if(cx2 > x2)
+					cx2 = x2;
+				for(; cx1 < cx2; cx1++)
+					write_pixels(&background, 1);
+				continue;
+			}
+			src = tm->atlas + 2
+					+ (((tile / atlas_columns) * tm->tile_height + line) * atlas_width)
+					+ ((tile % atlas_columns) * tm->tile_width);
+			if(cx1 < x1) {
+				src += x1 - cx1;
+				cx1 = x1;
+			}
+			if(cx2 > x2)
+				cx2 = x2;
+			write_pixels(src, cx2 - cx1);
+		}
+	}
+	end_pixels();
+}
+
+/*
+ * Draws the cells whose tile has changed since they were last drawn
+ */
+void tilemap_update(tilemap *tm) {
+	int row, column, first, index;
+
+	lcd_begin_transaction();
+	for(row = 0; row < tm->rows; row++) {
+		index = row * tm->columns;
+		column = 0;
+		while(column < tm->columns) {
+			//Skip cells that are the same
+			if(tm->shown[index + column] == tm->map[index + column]) {
+				column++;
+				continue;
+			}
+
+			//Find the end of this run of changed cells
+			first = column;
+			while(column < tm->columns && tm->shown[index + column] != tm->map[index + column]) {
+				tm->shown[index + column] = tm->map[index + column];
+				column++;
+			}
+			draw_tile_run(tm, row, first, column);
+		}
+	}
+	lcd_end_transaction();
+}
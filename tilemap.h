@@ -0,0 +1,39 @@
+/*
+ * Tile map drawing for the ILI9488
+ *
+ * File:   tilemap.h
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+#ifndef TILEMAP_H
+#define	TILEMAP_H
+
+#include "ILI9488.h"
+
+#define TILEMAP_MAX_CELLS 600 //Enough for 30 x 20 tiles of 16 x 16
+#define TILEMAP_BACKGROUND COLOR_BLACK //Cells whose tile isn't in the atlas
+
+/*
+ * A grid of tiles. map holds the tile index of each cell, row by row, and
+ * atlas is a bitmap (same format as draw_bitmap()) with the tiles side by
+ * side in a grid. tiles is how many tiles the atlas holds. shown is the
+ * tile last drawn in each cell.
+ */
+typedef struct {
+	int x, y;
+	int columns, rows;
+	int tile_width, tile_height;
+	const unsigned int *atlas;
+	const uint8_t *map;
+	int atlas_columns, tiles;
+	uint16_t shown[TILEMAP_MAX_CELLS];
+} tilemap;
+
+void tilemap_init(tilemap *tm, int x, int y, int columns, int rows, int tile_width, int tile_height,
+		const unsigned int *atlas, const uint8_t *map);
+void tilemap_update(tilemap *tm);
+void tilemap_invalidate(tilemap *tm);
+
+#endif	/* TILEMAP_H */
@@ -0,0 +1,166 @@
+/*
+ * 16-bit 8080 parallel transport for the ILI9488 driver on the FSMC / FMC.
+ *
+ * The display is set up in CubeMX as an SRAM / LCD bank with a 16-bit data
+ * bus, and DC is wired to address line FSMC_DC_ADDRESS. A write to the bank
+ * address is a command and a write to the address with that line high is
+ * data, so the FSMC makes the CS, DC and WR strobes itself and a pixel is a
+ * single 16-bit store.
+ *
+ * lcd_init() works the two addresses out from FSMC_BANK_ADDRESS and
+ * FSMC_DC_ADDRESS. A display on another bank gets its own in its lcd_display.
+ *
+ * Pixel buffers go out with memory to memory DMA in to the data address.
+ * Set the FSMC_DMA channel up in CubeMX as memory to memory, half word on
+ * both sides, with the source (peripheral) address incremented and the
+ * destination (memory) address fixed. One transfer moves at most 65535
+ * pixels, longer buffers go in pieces started from the completion interrupt.
+ *
+ * File:   transport_fsmc.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "lcd_transport.h"
+
+#if LCD_TRANSPORT == LCD_TRANSPORT_FSMC
+
+#include <string.h>
+
+#define LCD_COMMAND		(*(__IO uint16_t *)lcd->command_address)
+#define LCD_DATA		(*(__IO uint16_t *)lcd->data_address)
+
+transport_stats lcd_transport_stats;
+
+/*
+ * Starts DMA for as many pixels as one transfer can take and keeps the rest
+ * for the completion interrupt. len is in bytes.
+ */
+void fsmc_dma_piece(lcd_display *display, const uint8_t *data, uint32_t len) {
+	uint32_t count = len / 2 > TRANSPORT_DMA_MAX ? TRANSPORT_DMA_MAX : len / 2;
+
+	display->dma_next = data + count * 2;
+	display->dma_remaining = len - count * 2;
+	HAL_DMA_Start_IT(display->dma, (uint32_t)data, display->data_address, count);
+}
+
+/*
+ * Called by the HAL DMA interrupt handler when a transfer is done. The
+ * display is found by its DMA channel, it needn't be the selected one.
+ * The next piece of a long transfer is started straight away.
+ */
+void transport_dma_complete(DMA_HandleTypeDef *hdma) {
+	lcd_display *display;
+
+	for(int i = 0; i < lcd_display_count; i++) {
+		display = lcd_displays[i];
+		if(display->dma != hdma)
+			continue;
+
+		if(display->dma_remaining >= 2) {
+			fsmc_dma_piece(display, display->dma_next, display->dma_remaining);
+		} else {
+			display->dma_transfer_in_progress = 0;
+			lcd_os_signal(display);
+		}
+	}
+}
+
+/*
+ * CS, DC and WR belong to the FSMC, only the reset pin is a GPIO
+ */
+void transport_init() {
+	HAL_GPIO_WritePin(lcd->resx_port, lcd->resx_pin, GPIO_PIN_SET);
+	lcd->dma->XferCpltCallback = transport_dma_complete;
+}
+
+void transport_reset(int level) {
+	HAL_GPIO_WritePin(lcd->resx_port, lcd->resx_pin, level ? GPIO_PIN_SET : GPIO_PIN_RESET);
+}
+
+void transport_command(uint8_t command) {
+	lcd_os_wait(lcd);
+
+	LCD_COMMAND = command;
+	lcd_transport_stats.commands++;
+	lcd_transport_stats.transfers++;
+}
+
+/*
+ * Parameters are 8 bits, one write each on D0 to D7
+ */
+void transport_data(const uint8_t *data, unsigned int len) {
+	lcd_os_wait(lcd);
+
+	lcd_transport_stats.data_bytes += len;
+	lcd_transport_stats.transfers++;
+	while(len--)
+		LCD_DATA = *data++;
+}
+
+void transport_begin_data() {
+}
+
+/*
+ * Pixels are native 16-bit words, one write each
+ */
+void transport_write(const uint8_t *data, unsigned int len) {
+	uint16_t word;
+
+	lcd_os_wait(lcd);
+
+	lcd_transport_stats.data_bytes += len;
+	lcd_transport_stats.transfers++;
+	for(; len >= 2; len -= 2, data += 2) {
+		memcpy(&word, data, 2);
+		LCD_DATA = word;
+	}
+}
+
+/*
+ * Starts a DMA transfer from the buffer to the data address. The buffer
+ * must be half word aligned, and can be any length.
+ */
+void transport_write_dma(uint8_t *data, unsigned int len) {
+	lcd_os_wait(lcd);
+
+	lcd->dma_transfer_in_progress = 1;
+	lcd_transport_stats.dma_transfers++;
+	lcd_transport_stats.data_bytes += len;
+
+	fsmc_dma_piece(lcd, data, len);
+}
+
+void transport_wait() {
+	lcd_os_wait(lcd);
+}
+
+void transport_end() {
+	lcd_os_wait(lcd);
+}
+
+/*
+ * The FSMC drives CS for every access, so there is nothing to hold
+ */
+void transport_begin_transaction() {
+}
+
+void transport_end_transaction() {
+	lcd_os_wait(lcd);
+}
+
+void transport_delay(uint32_t ms) {
+	HAL_Delay(ms);
+}
+
+uint32_t transport_ticks() {
+	return HAL_GetTick();
+}
+
+void transport_reset_stats() {
+	memset(&lcd_transport_stats, 0, sizeof(lcd_transport_stats));
+}
+
+#endif
@@ -0,0 +1,380 @@
+/*
+ * Host mock transport for the ILI9488 driver.
+ *
+ * Lets the driver run on a PC. The commands the display understands for
+ * drawing (CASET, PASET, RAMWR, MADCTL, COLMOD and the scrolling registers)
+ * are emulated in to a copy of the display memory that tests can read back.
+ * The time each write would take on the bus is added up with a simple model
+ * so backends and drawing functions can be compared off target.
+ *
+ * Build with -DLCD_TRANSPORT=LCD_TRANSPORT_HOST for an SPI display, or
+ * -DLCD_TRANSPORT=LCD_TRANSPORT_HOST_PARALLEL for a 16-bit 8080 bus where
+ * every command, parameter and pixel is one write cycle.
+ *
+ * DMA transfers finish straight away unless host_dma_async is set. Then a
+ * transfer is left running, like real DMA, until another thread playing
+ * the DMA interrupt calls host_dma_complete(). The pixels are only read
+ * from the buffer then, so one that changes while it is being sent shows.
+ * That is how the waiting in lcd_os.h is tested with os_pthread.c.
+ *
+ * File:   transport_host.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "lcd_transport.h"
+
+#if LCD_HOST
+
+#include <string.h>
+
+transport_stats lcd_transport_stats;
+
+/*
+ * Bus timing model, in nanoseconds. A cycle is one SPI clock (8 per byte) or
+ * one write strobe on the parallel bus. The SPI defaults are a 40 MHz clock
+ * with the HAL overhead for each call, the parallel ones the 66 ns shortest
+ * write cycle of the ILI9488. host_select_ns is the cost of pulling CS low
+ * and back up. Change them to model another bus.
+ */
+#if LCD_PARALLEL
+uint32_t host_cycle_ns = 66;
+uint32_t host_call_ns = 200;
+uint32_t host_dma_ns = 1000;
+#else
+uint32_t host_cycle_ns = 25;
+uint32_t host_call_ns = 2000;
+uint32_t host_dma_ns = 3000;
+#endif
+uint32_t host_select_ns = 100;
+uint64_t host_time_ns = 0;
+uint64_t host_cycles = 0;
+
+//Emulated display for lcd_default, see struct host_panel
+struct host_panel host_default_panel = {
+	.colmod = 0x66,
+	.scroll_size = ILI9488_TFTHEIGHT,
+	.reset = 1,
+};
+uint32_t host_errors = 0;
+volatile uint8_t host_dma_async = 0;
+
+/*
+ * Puts a pixel where the current column and page point and moves on, like
+ * the display does.
+ */
+void host_store_pixel(struct host_panel *panel) {
+	unsigned int a = panel->column, b = panel->page;
+	unsigned int x, y, colour;
+
+	if(panel->madctl & MADCTL_MV) {
+		a = panel->page;
+		b = panel->column;
+	}
+	x = (panel->madctl & MADCTL_MX) ? (ILI9488_TFTWIDTH - 1) - a : a;
+	y = (panel->madctl & MADCTL_MY) ? (ILI9488_TFTHEIGHT - 1) - b : b;
+
+	if(x < ILI9488_TFTWIDTH && y < ILI9488_TFTHEIGHT) {
+		if(panel->pixel_count == 2) {
+			//16 bits per pixel, RGB 5-6-5
+			colour = (panel->pixel_data[0] << 8) | panel->pixel_data[1];
+			panel->gram[y][x][0] = (colour >> 8) & 0xF8;
+			panel->gram[y][x][1] = (colour >> 3) & 0xFC;
+			panel->gram[y][x][2] = (colour << 3) & 0xF8;
+		} else {
+			panel->gram[y][x][0] = panel->pixel_data[0] & 0xFC;
+			panel->gram[y][x][1] = panel->pixel_data[1] & 0xFC;
+			panel->gram[y][x][2] = panel->pixel_data[2] & 0xFC;
+		}
+	} else {
+		host_errors++;
+	}
+
+	if(++panel->column > panel->column_end) {
+		panel->column = panel->column_start;
+		if(++panel->page > panel->page_end)
+			panel->page = panel->page_start;
+	}
+}
+
+/*
+ * Handles one data byte for the last command
+ */
+void host_data_byte(struct host_panel *panel, uint8_t data) {
+	unsigned int pixel_bytes = ((panel->colmod & 0x07) == 0x05) ? 2 : 3;
+
+	if(!panel->selected || !panel->reset)
+		host_errors++;
+
+	if(panel->command == ILI9488_RAMWR) {
+		panel->pixel_data[panel->pixel_count++] = data;
+		if(panel->pixel_count == pixel_bytes) {
+			host_store_pixel(panel);
+			panel->pixel_count = 0;
+		}
+		return;
+	}
+
+	if(panel->param_count < sizeof(panel->params))
+		panel->params[panel->param_count] = data;
+	panel->param_count++;
+
+	switch(panel->command) {
+	case ILI9488_CASET:
+		if(panel->param_count == 4) {
+			panel->column_start = (panel->params[0] << 8) | panel->params[1];
+			panel->column_end = (panel->params[2] << 8) | panel->params[3];
+		}
+		break;
+	case ILI9488_PASET:
+		if(panel->param_count == 4) {
+			panel->page_start = (panel->params[0] << 8) | panel->params[1];
+			panel->page_end = (panel->params[2] << 8) | panel->params[3];
+		}
+		break;
+	case ILI9488_MADCTL:
+		panel->madctl = data;
+		break;
+	case ILI9488_PIXFMT:
+		panel->colmod = data;
+		break;
+	case ILI9488_VSCRDEF:
+		if(panel->param_count == 6) {
+			panel->scroll_top = (panel->params[0] << 8) | panel->params[1];
+			panel->scroll_size = (panel->params[2] << 8) | panel->params[3];
+			if(panel->scroll_top + panel->scroll_size + ((panel->params[4] << 8) | panel->params[5]) != ILI9488_TFTHEIGHT)
+				host_errors++;
+		}
+		break;
+	case ILI9488_VSCRSADD:
+		if(panel->param_count == 2)
+			panel->scroll_start = (panel->params[0] << 8) | panel->params[1];
+		break;
+	}
+}
+
+void host_data(const uint8_t *data, unsigned int len) {
+	while(len--)
+		host_data_byte(lcd->panel, *data++);
+}
+
+/*
+ * Handles pixel data. On the parallel bus each pixel is one 16-bit write,
+ * passed as native words the way DMA would read them.
+ */
+void host_pixels(struct host_panel *panel, const uint8_t *data, unsigned int len) {
+#if LCD_PARALLEL
+	uint16_t word;
+
+	if(panel->command != ILI9488_RAMWR || (panel->colmod & 0x07) != 0x05 || (len & 1))
+		host_errors++;
+	for(; len >= 2; len -= 2, data += 2) {
+		memcpy(&word, data, 2);
+		host_data_byte(panel, word >> 8);
+		host_data_byte(panel, word & 0xFF);
+	}
+#else
+	while(len--)
+		host_data_byte(panel, *data++);
+#endif
+}
+
+/*
+ * Adds the time for a call that moves len bytes of parameters (words is 0)
+ * or pixels (words is 1)
+ */
+void host_bus(uint32_t call_ns, unsigned int len, int words) {
+	uint32_t cycles;
+
+#if LCD_PARALLEL
+	cycles = words ? len / 2 : len;
+#else
+	cycles = len * 8;
+#endif
+	host_cycles += cycles;
+	host_time_ns += call_ns + (uint64_t)host_cycle_ns * cycles;
+}
+
+/*
+ * Pixel the panel shows at x, y in its own 320 x 480 portrait order, with
+ * scrolling applied, as 0xRRGGBB.
+ */
+uint32_t host_panel_pixel(struct host_panel *panel, int x, int y) {
+	uint8_t *px;
+
+	if(y >= panel->scroll_top && y < panel->scroll_top + panel->scroll_size)
+		y = panel->scroll_top + ((panel->scroll_start - panel->scroll_top) + (y - panel->scroll_top)) % panel->scroll_size;
+	px = panel->gram[y][x];
+	return (px[0] << 16) | (px[1] << 8) | px[2];
+}
+
+/*
+ * The same for the selected display
+ */
+uint32_t host_pixel(int x, int y) {
+	return host_panel_pixel(lcd->panel, x, y);
+}
+
+/*
+ * A 16-bit colour as host_pixel() returns it
+ */
+uint32_t host_colour(unsigned int colour) {
+	return (((colour >> 8) & 0xF8) << 16) | (((colour >> 3) & 0xFC) << 8) | ((colour << 3) & 0xF8);
+}
+
+/*
+ * CS goes low for each write unless a transaction is holding it low
+ */
+void host_select() {
+	if(!lcd->transaction_depth) {
+		lcd->panel->selected = 1;
+		lcd_transport_stats.selects++;
+		host_time_ns += host_select_ns;
+	}
+}
+
+void host_release() {
+	if(!lcd->transaction_depth)
+		lcd->panel->selected = 0;
+}
+
+/*
+ * A display without a panel of its own gets the default one
+ */
+void transport_init() {
+	if(!lcd->panel)
+		lcd->panel = &host_default_panel;
+	lcd->panel->selected = 0;
+}
+
+void transport_reset(int level) {
+	struct host_panel *panel = lcd->panel;
+
+	panel->reset = level;
+	if(!level) {
+		panel->madctl = 0;
+		panel->colmod = 0x66;
+		panel->scroll_top = 0;
+		panel->scroll_size = ILI9488_TFTHEIGHT;
+		panel->scroll_start = 0;
+	}
+}
+
+void transport_command(uint8_t command) {
+	struct host_panel *panel = lcd->panel;
+
+	lcd_os_wait(lcd);
+	host_select();
+	panel->command = command;
+	panel->param_count = 0;
+	panel->pixel_count = 0;
+	if(command == ILI9488_RAMWR) {
+		panel->column = panel->column_start;
+		panel->page = panel->page_start;
+	}
+
+	lcd_transport_stats.commands++;
+	lcd_transport_stats.transfers++;
+	host_bus(host_call_ns, 1, 0);
+	host_release();
+}
+
+void transport_data(const uint8_t *data, unsigned int len) {
+	lcd_os_wait(lcd);
+	host_select();
+	host_data(data, len);
+	host_release();
+
+	lcd_transport_stats.data_bytes += len;
+	lcd_transport_stats.transfers++;
+	host_bus(host_call_ns, len, 0);
+}
+
+void transport_begin_data() {
+	host_select();
+}
+
+void transport_write(const uint8_t *data, unsigned int len) {
+	lcd_os_wait(lcd);
+	host_pixels(lcd->panel, data, len);
+
+	lcd_transport_stats.data_bytes += len;
+	lcd_transport_stats.transfers++;
+	host_bus(host_call_ns, len, 1);
+}
+
+/*
+ * The mock DMA finishes straight away, or with host_dma_async when
+ * host_dma_complete() is called
+ */
+void transport_write_dma(uint8_t *data, unsigned int len) {
+	lcd_os_wait(lcd);
+	if(host_dma_async) {
+		lcd->host_dma_data = data;
+		lcd->host_dma_len = len;
+		lcd->dma_transfer_in_progress = 1;
+	} else {
+		host_pixels(lcd->panel, data, len);
+	}
+
+	lcd_transport_stats.data_bytes += len;
+	lcd_transport_stats.dma_transfers++;
+	host_bus(host_dma_ns, len, 1);
+}
+
+/*
+ * Finishes the display's running transfer, as its DMA completion interrupt
+ * would. Call it from another thread. Returns 0 if nothing was running.
+ */
+int host_dma_complete(lcd_display *display) {
+	if(!display->dma_transfer_in_progress)
+		return 0;
+
+	host_pixels(display->panel, display->host_dma_data, display->host_dma_len);
+	display->dma_transfer_in_progress = 0;
+	lcd_os_signal(display);
+	return 1;
+}
+
+void transport_wait() {
+	lcd_os_wait(lcd);
+}
+
+void transport_end() {
+	lcd_os_wait(lcd);
+	host_release();
+}
+
+void transport_begin_transaction() {
+	if(lcd->transaction_depth++ == 0) {
+		lcd->panel->selected = 1;
+		lcd_transport_stats.selects++;
+		host_time_ns += host_select_ns;
+	}
+}
+
+void transport_end_transaction() {
+	if(!lcd->transaction_depth)
+		return;
+	if(--lcd->transaction_depth == 0)
+		lcd->panel->selected = 0;
+}
+
+void transport_delay(uint32_t ms) {
+	host_time_ns += (uint64_t)ms * 1000000;
+}
+
+/*
+ * Milliseconds of modelled bus time
+ */
+uint32_t transport_ticks() {
+	return host_time_ns / 1000000;
+}
+
+void transport_reset_stats() {
+	memset(&lcd_transport_stats, 0, sizeof(lcd_transport_stats));
+}
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * 16-bit 8080 parallel transport for the ILI9488 driver, on GPIO pins.
+ *
+ * D0 to D15 are the 16 pins of lcd->data_port, written in one go through ODR,
+ * and each write is latched by pulsing WR low. Commands and parameters are
+ * one write per byte and pixels one write each as RGB 5-6-5, so a pixel
+ * costs one bus cycle instead of 24 SPI clocks. There is nothing for DMA
+ * to do here (WR has to be pulsed for every word), so transport_write_dma()
+ * sends the data straight away.
+ *
+ * Set the data pins, CS, DC, WR, RD and RESX up as fast push-pull outputs
+ * in CubeMX.
+ *
+ * File:   transport_parallel.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "lcd_transport.h"
+
+#if LCD_TRANSPORT == LCD_TRANSPORT_PARALLEL
+
+#include <string.h>
+
+transport_stats lcd_transport_stats;
+
+//GPIO pin set and reset through BSRR
+#define PIN_HIGH(port, pin) ((port)->BSRR = (pin))
+#define PIN_LOW(port, pin)  ((port)->BSRR = (uint32_t)(pin) << 16)
+
+/*
+ * Pulls CS low for a command or parameter write. Inside a transaction it is
+ * already low and stays that way.
+ */
+void cs_select() {
+	if(!lcd->transaction_depth) {
+		PIN_LOW(lcd->cs_port, lcd->cs_pin);
+		lcd_transport_stats.selects++;
+	}
+}
+
+void cs_release() {
+	if(!lcd->transaction_depth)
+		PIN_HIGH(lcd->cs_port, lcd->cs_pin);
+}
+
+/*
+ * Puts a word on the data pins and latches it with the WR strobe
+ */
+#define BUS_WRITE(value) do { \
+	lcd->data_port->ODR = (value); \
+	PIN_LOW(lcd->wr_port, lcd->wr_pin); \
+	PIN_HIGH(lcd->wr_port, lcd->wr_pin); \
+} while(0)
+
+/*
+ * Sets the control pins HIGH (they are active LOW)
+ */
+void transport_init() {
+	PIN_HIGH(lcd->resx_port, lcd->resx_pin);
+	PIN_HIGH(lcd->cs_port, lcd->cs_pin);
+	PIN_HIGH(lcd->dc_port, lcd->dc_pin);
+	PIN_HIGH(lcd->wr_port, lcd->wr_pin);
+	PIN_HIGH(lcd->rd_port, lcd->rd_pin);
+}
+
+void transport_reset(int level) {
+	if(level)
+		PIN_HIGH(lcd->resx_port, lcd->resx_pin);
+	else
+		PIN_LOW(lcd->resx_port, lcd->resx_pin);
+}
+
+void transport_command(uint8_t command) {
+	PIN_LOW(lcd->dc_port, lcd->dc_pin);
+	cs_select();
+
+	BUS_WRITE(command);
+	lcd_transport_stats.commands++;
+	lcd_transport_stats.transfers++;
+
+	cs_release();
+}
+
+/*
+ * Parameters are 8 bits, one write each on D0 to D7
+ */
+void transport_data(const uint8_t *data, unsigned int len) {
+	PIN_HIGH(lcd->dc_port, lcd->dc_pin);
+	cs_select();
+
+	lcd_transport_stats.data_bytes += len;
+	lcd_transport_stats.transfers++;
+	while(len--)
+		BUS_WRITE(*data++);
+
+	cs_release();
+}
+
+void transport_begin_data() {
+	PIN_HIGH(lcd->dc_port, lcd->dc_pin);
+	cs_select();
+}
+
+/*
+ * Pixels are native 16-bit words, one write each
+ */
+void transport_write(const uint8_t *data, unsigned int len) {
+	uint16_t word;
+
+	lcd_transport_stats.data_bytes += len;
+	lcd_transport_stats.transfers++;
+	for(; len >= 2; len -= 2, data += 2) {
+		memcpy(&word, data, 2);
+		BUS_WRITE(word);
+	}
+}
+
+/*
+ * The GPIO bus can't be driven by DMA, so the data is sent now
+ */
+void transport_write_dma(uint8_t *data, unsigned int len) {
+	transport_write(data, len);
+}
+
+void transport_wait() {
+}
+
+void transport_end() {
+	cs_release();
+}
+
+/*
+ * Holds CS low until the matching transport_end_transaction(). Can be nested.
+ */
+void transport_begin_transaction() {
+	if(lcd->transaction_depth++ == 0) {
+		PIN_LOW(lcd->cs_port, lcd->cs_pin);
+		lcd_transport_stats.selects++;
+	}
+}
+
+void transport_end_transaction() {
+	if(!lcd->transaction_depth)
+		return;
+	if(--lcd->transaction_depth == 0)
+		PIN_HIGH(lcd->cs_port, lcd->cs_pin);
+}
+
+void transport_delay(uint32_t ms) {
+	HAL_Delay(ms);
+}
+
+uint32_t transport_ticks() {
+	return HAL_GetTick();
+}
+
+void transport_reset_stats() {
+	memset(&lcd_transport_stats, 0, sizeof(lcd_transport_stats));
+}
+
+#endif
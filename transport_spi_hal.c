@@ -0,0 +1,250 @@
+/*
+ * SPI transport for the ILI9488 driver using the STM32 HAL.
+ *
+ * Pixel data is sent with HAL_SPI_Transmit() and HAL_SPI_Transmit_DMA().
+ * Commands and parameters are only a byte or a few, where the HAL call
+ * costs far more than the byte itself, so they are written straight to the
+ * SPI data register instead (see transport_spi_regs.c). CS and DC are driven
+ * through the GPIO BSRR register.
+ *
+ * The HAL takes at most 65535 bytes per call, so longer writes are split.
+ * A long DMA write is chained, the completion callback starts each piece
+ * after the last so the CPU isn't involved between them.
+ *
+ * File:   transport_spi_hal.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "lcd_transport.h"
+
+#if LCD_TRANSPORT == LCD_TRANSPORT_SPI_HAL
+
+transport_stats lcd_transport_stats;
+
+//GPIO pin set and reset through BSRR
+#define PIN_HIGH(port, pin) ((port)->BSRR = (pin))
+#define PIN_LOW(port, pin)  ((port)->BSRR = (uint32_t)(pin) << 16)
+
+/*
+ * Pulls CS low for a command or parameter write. Inside a transaction it is
+ * already low and stays that way.
+ */
+void cs_select() {
+	if(!lcd->transaction_depth) {
+		PIN_LOW(lcd->cs_port, lcd->cs_pin);
+		lcd_transport_stats.selects++;
+	}
+}
+
+void cs_release() {
+	if(!lcd->transaction_depth)
+		PIN_HIGH(lcd->cs_port, lcd->cs_pin);
+}
+
+/*
+ * Sets the control pins HIGH (they are active LOW)
+ */
+void transport_init() {
+	HAL_GPIO_WritePin(lcd->resx_port, lcd->resx_pin, GPIO_PIN_SET);
+	PIN_HIGH(lcd->cs_port, lcd->cs_pin);
+	PIN_HIGH(lcd->dc_port, lcd->dc_pin);
+}
+
+/*
+ * Sets the reset pin, 0 holds the display in reset
+ */
+void transport_reset(int level) {
+	HAL_GPIO_WritePin(lcd->resx_port, lcd->resx_pin, level ? GPIO_PIN_SET : GPIO_PIN_RESET);
+}
+
+/*
+ * Writes bytes to SPI without changing chip select (CS) state, once the
+ * port is free.
+ */
+void spi_write(const uint8_t *data, unsigned int len) {
+	unsigned int count;
+
+	//Wait for any DMA transfer, then check the device is free. The HAL is
+	//back to ready before it calls HAL_SPI_TxCpltCallback(), so this only
+	//spins if something else is using the SPI.
+	lcd_os_wait(lcd);
+	while(HAL_SPI_GetState(lcd->spi) != HAL_SPI_STATE_READY);
+
+	do {
+		count = len > TRANSPORT_DMA_MAX ? TRANSPORT_DMA_MAX : len;
+		//At least 10 ms, more for big buffers
+		HAL_SPI_Transmit(lcd->spi, (uint8_t *)data, count, 10 + count / 1024);
+		data += count;
+		len -= count;
+	} while(len);
+	lcd_transport_stats.transfers++;
+}
+
+/*
+ * Starts DMA for as much of the data as one transfer can take and keeps
+ * the rest for the completion callback
+ */
+void spi_dma_piece(lcd_display *display, const uint8_t *data, uint32_t len) {
+	uint32_t count = len > TRANSPORT_DMA_MAX ? TRANSPORT_DMA_MAX : len;
+
+	display->dma_next = data + count;
+	display->dma_remaining = len - count;
+	HAL_SPI_Transmit_DMA(display->spi, (uint8_t *)data, count);
+}
+
+/*
+ * Writes a few bytes without the HAL, once any DMA transfer is done. The
+ * frame size is back to the 8 bits the HAL expects afterwards.
+ */
+void spi_write_fast(const uint8_t *data, unsigned int len) {
+	lcd_os_wait(lcd);
+	while(HAL_SPI_GetState(lcd->spi) != HAL_SPI_STATE_READY);
+
+	//The HAL turns the SPI on in its first transfer
+	if(!(lcd->spi->Instance->CR1 & SPI_CR1_SPE))
+		__HAL_SPI_ENABLE(lcd->spi);
+
+	spi_write_registers(lcd->spi->Instance, data, len);
+	lcd_transport_stats.transfers++;
+}
+
+/*
+ * Writes a command byte to the display
+ */
+void transport_command(uint8_t command) {
+	PIN_LOW(lcd->dc_port, lcd->dc_pin);
+	cs_select();
+
+	spi_write_fast(&command, 1);
+	lcd_transport_stats.commands++;
+
+	cs_release();
+}
+
+/*
+ * Writes parameter bytes for the last command. Pulls CS low as required.
+ */
+void transport_data(const uint8_t *data, unsigned int len) {
+	PIN_HIGH(lcd->dc_port, lcd->dc_pin);
+	cs_select();
+
+	spi_write_fast(data, len);
+	lcd_transport_stats.data_bytes += len;
+
+	cs_release();
+}
+
+/*
+ * Starts a run of pixel data. CS stays low until transport_end().
+ */
+void transport_begin_data() {
+	PIN_HIGH(lcd->dc_port, lcd->dc_pin);
+	cs_select();
+}
+
+/*
+ * Sends pixel data and waits for it to go
+ */
+void transport_write(const uint8_t *data, unsigned int len) {
+	spi_write(data, len);
+	lcd_transport_stats.data_bytes += len;
+}
+
+/*
+ * Starts sending pixel data with DMA. The buffer mustn't change until the
+ * next transport_write_dma(), transport_wait() or transport_end(). It can be
+ * any length.
+ */
+void transport_write_dma(uint8_t *data, unsigned int len) {
+	//Check if the DMA is busy
+	lcd_os_wait(lcd);
+
+	//Set the DMA transfer flag to block overwriting
+	lcd->dma_transfer_in_progress = 1;
+	lcd_transport_stats.dma_transfers++;
+	lcd_transport_stats.data_bytes += len;
+
+	spi_dma_piece(lcd, data, len);
+}
+
+/*
+ * Waits for the DMA transfer to finish
+ */
+void transport_wait() {
+	lcd_os_wait(lcd);
+}
+
+/*
+ * Waits for the DMA transfer to finish and returns CS to high
+ */
+void transport_end() {
+	lcd_os_wait(lcd);
+	cs_release();
+}
+
+/*
+ * Holds CS low until the matching transport_end_transaction(). Can be nested.
+ */
+void transport_begin_transaction() {
+	if(lcd->transaction_depth++ == 0) {
+		PIN_LOW(lcd->cs_port, lcd->cs_pin);
+		lcd_transport_stats.selects++;
+	}
+}
+
+/*
+ * Returns CS to high once the last transaction ends and the data has gone
+ */
+void transport_end_transaction() {
+	if(!lcd->transaction_depth)
+		return;
+	if(--lcd->transaction_depth == 0) {
+		lcd_os_wait(lcd);
+		PIN_HIGH(lcd->cs_port, lcd->cs_pin);
+	}
+}
+
+/*
+ * Callback for when the DMA transfer is complete.
+ * Starts the next piece of a long transfer straight away, otherwise clears
+ * the flag of the display on that SPI to allow its next transfer and wakes
+ * any task waiting for it.
+ */
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi) {
+	lcd_display *display;
+
+	for(int i = 0; i < lcd_display_count; i++) {
+		display = lcd_displays[i];
+		if(display->spi->Instance != hspi->Instance)
+			continue;
+
+		if(display->dma_remaining) {
+			spi_dma_piece(display, display->dma_next, display->dma_remaining);
+		} else {
+			// DMA transfer complete, ready for next buffer
+			display->dma_transfer_in_progress = 0;
+			lcd_os_signal(display);
+		}
+	}
+}
+
+void transport_delay(uint32_t ms) {
+	HAL_Delay(ms);
+}
+
+uint32_t transport_ticks() {
+	return HAL_GetTick();
+}
+
+void transport_reset_stats() {
+	lcd_transport_stats.commands = 0;
+	lcd_transport_stats.data_bytes = 0;
+	lcd_transport_stats.transfers = 0;
+	lcd_transport_stats.dma_transfers = 0;
+	lcd_transport_stats.selects = 0;
+}
+
+#endif
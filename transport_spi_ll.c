@@ -0,0 +1,306 @@
+/*
+ * Register level SPI transport for the ILI9488 driver.
+ *
+ * Bytes are written straight to the SPI data register and CS / DC are set
+ * through the GPIO BSRR register, so there is no HAL call per command.
+ * Pixel data goes out with DMA, started with HAL_DMA_Start_IT() on the SPI's
+ * TX channel. The DMA interrupt must still call HAL_DMA_IRQHandler() as
+ * generated by CubeMX.
+ *
+ * Written for the STM32L4 SPI (with a FIFO). Other families need the
+ * status bits checked.
+ *
+ * With SPI_16BIT_FRAMES the data goes out two bytes per frame. DMA reads
+ * half words low byte first, so a buffer has its bytes swapped in pairs
+ * while it is being sent. An odd last byte is sent on its own as an 8-bit
+ * frame. Both are done by the task that waits for the transfer (see
+ * dma_wait()), never in the interrupt, which only has to say the transfer
+ * is done. The bytes are put back once it is, except when the same buffer
+ * is sent again straight away, as a line is for each row it covers.
+ * Half words can't be read from an odd address, so a buffer that starts on
+ * one is written out byte by byte instead.
+ *
+ * A DMA transfer can move at most 65535 frames. Longer buffers are sent in
+ * pieces, each started from the completion interrupt of the last.
+ *
+ * File:   transport_spi_ll.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "lcd_transport.h"
+
+#if LCD_TRANSPORT == LCD_TRANSPORT_SPI_LL
+
+transport_stats lcd_transport_stats;
+
+//GPIO pin set and reset through BSRR
+#define PIN_HIGH(port, pin) ((port)->BSRR = (pin))
+#define PIN_LOW(port, pin)  ((port)->BSRR = (uint32_t)(pin) << 16)
+
+/*
+ * Pulls CS low for a command or parameter write. Inside a transaction it is
+ * already low and stays that way.
+ */
+void cs_select() {
+	if(!lcd->transaction_depth) {
+		PIN_LOW(lcd->cs_port, lcd->cs_pin);
+		lcd_transport_stats.selects++;
+	}
+}
+
+void cs_release() {
+	if(!lcd->transaction_depth)
+		PIN_HIGH(lcd->cs_port, lcd->cs_pin);
+}
+
+#if SPI_16BIT_FRAMES
+/*
+ * Swaps each pair of bytes, a word at a time when the buffer is aligned
+ */
+void swap_pairs(uint8_t *data, unsigned int len) {
+	uint8_t byte;
+
+	if(((uintptr_t)data & 3) == 0) {
+		for(; len >= 4; len -= 4, data += 4)
+			*(uint32_t *)data = __REV16(*(uint32_t *)data);
+	}
+	for(; len >= 2; len -= 2, data += 2) {
+		byte = data[0];
+		data[0] = data[1];
+		data[1] = byte;
+	}
+}
+#endif
+
+/*
+ * Starts DMA for as many frames as one transfer can take and keeps the rest
+ * for the completion interrupt. len is in bytes.
+ */
+void spi_dma_piece(lcd_display *display, const uint8_t *data, uint32_t len) {
+#if SPI_16BIT_FRAMES
+	uint32_t count = len / 2 > TRANSPORT_DMA_MAX ? TRANSPORT_DMA_MAX : len / 2;
+	uint32_t bytes = count * 2;
+#else
+	uint32_t count = len > TRANSPORT_DMA_MAX ? TRANSPORT_DMA_MAX : len;
+	uint32_t bytes = count;
+#endif
+
+	display->dma_next = data + bytes;
+	display->dma_remaining = len - bytes;
+	HAL_DMA_Start_IT(display->spi->hdmatx, (uint32_t)data, (uint32_t)&display->spi->Instance->DR, count);
+}
+
+/*
+ * Waits for the DMA transfer to finish. With SPI_16BIT_FRAMES an odd last
+ * byte is then sent as an 8-bit frame. That waits for the SPI to empty, so
+ * it is done here rather than in the interrupt.
+ */
+void dma_wait() {
+	lcd_os_wait(lcd);
+#if SPI_16BIT_FRAMES
+	if(lcd->dma_tail >= 0) {
+		spi_frame_size(lcd->spi->Instance, 8);
+		*(__IO uint8_t *)&lcd->spi->Instance->DR = lcd->dma_tail;
+		lcd->dma_tail = -1;
+	}
+#endif
+}
+
+/*
+ * Same as above, and puts the bytes of the last buffer back in order so
+ * the caller can use it again
+ */
+void dma_done() {
+	dma_wait();
+#if SPI_16BIT_FRAMES
+	if(lcd->dma_swapped) {
+		swap_pairs(lcd->dma_swapped, lcd->dma_swapped_len);
+		lcd->dma_swapped = NULL;
+	}
+#endif
+}
+
+/*
+ * Called by the HAL DMA interrupt handler when a transfer is done. The
+ * display is found by its DMA channel, it needn't be the selected one.
+ * The next piece of a long transfer is started straight away.
+ */
+void transport_dma_complete(DMA_HandleTypeDef *hdma) {
+	lcd_display *display;
+
+	for(int i = 0; i < lcd_display_count; i++) {
+		display = lcd_displays[i];
+		if(display->spi->hdmatx != hdma)
+			continue;
+
+		if(display->dma_remaining) {
+			spi_dma_piece(display, display->dma_next, display->dma_remaining);
+			continue;
+		}
+
+		display->spi->Instance->CR2 &= ~SPI_CR2_TXDMAEN;
+		display->dma_transfer_in_progress = 0;
+		lcd_os_signal(display);
+	}
+}
+
+/*
+ * Sets the control pins HIGH (they are active LOW) and turns the SPI on
+ */
+void transport_init() {
+	PIN_HIGH(lcd->resx_port, lcd->resx_pin);
+	PIN_HIGH(lcd->cs_port, lcd->cs_pin);
+	PIN_HIGH(lcd->dc_port, lcd->dc_pin);
+
+	lcd->spi->hdmatx->XferCpltCallback = transport_dma_complete;
+#if SPI_16BIT_FRAMES
+	//DMA moves half words
+	lcd->spi->hdmatx->Instance->CCR = (lcd->spi->hdmatx->Instance->CCR & ~(DMA_CCR_PSIZE | DMA_CCR_MSIZE))
+			| DMA_CCR_PSIZE_0 | DMA_CCR_MSIZE_0;
+#endif
+	__HAL_SPI_ENABLE(lcd->spi);
+}
+
+void transport_reset(int level) {
+	if(level)
+		PIN_HIGH(lcd->resx_port, lcd->resx_pin);
+	else
+		PIN_LOW(lcd->resx_port, lcd->resx_pin);
+}
+
+/*
+ * Writes bytes to the SPI data register once any DMA transfer is done, see
+ * transport_spi_regs.c
+ */
+void spi_write(const uint8_t *data, unsigned int len) {
+	dma_done();
+	spi_write_registers(lcd->spi->Instance, data, len);
+	lcd_transport_stats.transfers++;
+}
+
+void transport_command(uint8_t command) {
+	PIN_LOW(lcd->dc_port, lcd->dc_pin);
+	cs_select();
+
+	spi_write(&command, 1);
+	lcd_transport_stats.commands++;
+
+	cs_release();
+}
+
+void transport_data(const uint8_t *data, unsigned int len) {
+	PIN_HIGH(lcd->dc_port, lcd->dc_pin);
+	cs_select();
+
+	spi_write(data, len);
+	lcd_transport_stats.data_bytes += len;
+
+	cs_release();
+}
+
+void transport_begin_data() {
+	PIN_HIGH(lcd->dc_port, lcd->dc_pin);
+	cs_select();
+}
+
+void transport_write(const uint8_t *data, unsigned int len) {
+	spi_write(data, len);
+	lcd_transport_stats.data_bytes += len;
+}
+
+/*
+ * Starts a DMA transfer from the buffer to the SPI data register. It can be
+ * any length.
+ */
+void transport_write_dma(uint8_t *data, unsigned int len) {
+	unsigned int bytes = len;
+
+#if SPI_16BIT_FRAMES
+	if(len < 2 || ((uintptr_t)data & 1)) {
+		transport_write(data, len);
+		return;
+	}
+
+	//The same buffer again is still swapped from last time
+	if(data == lcd->dma_swapped && (len & ~1) == lcd->dma_swapped_len) {
+		dma_wait();
+	} else {
+		dma_done();
+		lcd->dma_swapped = data;
+		lcd->dma_swapped_len = len & ~1;
+		swap_pairs(lcd->dma_swapped, lcd->dma_swapped_len);
+	}
+	lcd->dma_tail = (len & 1) ? data[len - 1] : -1;
+	spi_frame_size(lcd->spi->Instance, 16);
+	bytes = len & ~1;
+#else
+	lcd_os_wait(lcd);
+#endif
+
+	lcd->dma_transfer_in_progress = 1;
+	lcd_transport_stats.dma_transfers++;
+	lcd_transport_stats.data_bytes += len;
+
+	spi_dma_piece(lcd, data, bytes);
+	lcd->spi->Instance->CR2 |= SPI_CR2_TXDMAEN;
+}
+
+void transport_wait() {
+	dma_done();
+}
+
+/*
+ * Waits for the DMA and for the SPI to send its last byte
+ */
+void spi_flush() {
+	dma_done();
+	spi_drain(lcd->spi->Instance);
+}
+
+/*
+ * Waits for the pixel data to go, then returns CS to high
+ */
+void transport_end() {
+	spi_flush();
+	cs_release();
+}
+
+/*
+ * Holds CS low until the matching transport_end_transaction(). Can be nested.
+ */
+void transport_begin_transaction() {
+	if(lcd->transaction_depth++ == 0) {
+		PIN_LOW(lcd->cs_port, lcd->cs_pin);
+		lcd_transport_stats.selects++;
+	}
+}
+
+void transport_end_transaction() {
+	if(!lcd->transaction_depth)
+		return;
+	if(--lcd->transaction_depth == 0) {
+		spi_flush();
+		PIN_HIGH(lcd->cs_port, lcd->cs_pin);
+	}
+}
+
+void transport_delay(uint32_t ms) {
+	HAL_Delay(ms);
+}
+
+uint32_t transport_ticks() {
+	return HAL_GetTick();
+}
+
+void transport_reset_stats() {
+	lcd_transport_stats.commands = 0;
+	lcd_transport_stats.data_bytes = 0;
+	lcd_transport_stats.transfers = 0;
+	lcd_transport_stats.dma_transfers = 0;
+	lcd_transport_stats.selects = 0;
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * Register level SPI helpers shared by the two SPI transports.
+ *
+ * Commands and parameters are only a byte or a few, where a HAL call or a
+ * DMA transfer costs far more than the byte itself, so both
+ * transport_spi_hal.c and transport_spi_ll.c write them straight to the
+ * SPI data register with these. Keeping them in one place means a fix to
+ * the FIFO or frame size handling reaches both backends.
+ *
+ * Written for the STM32L4 SPI (with a FIFO). Other families need the
+ * status bits checked.
+ *
+ * File:   transport_spi_regs.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "lcd_transport.h"
+
+#if LCD_TRANSPORT == LCD_TRANSPORT_SPI_HAL || LCD_TRANSPORT == LCD_TRANSPORT_SPI_LL
+
+#if SPI_16BIT_FRAMES
+/*
+ * Changes the SPI frame size between 8 and 16 bits once the last frame has
+ * gone out
+ */
+void spi_frame_size(SPI_TypeDef *spi, int bits) {
+	uint32_t ds = (uint32_t)(bits - 1) << SPI_CR2_DS_Pos;
+
+	if((spi->CR2 & SPI_CR2_DS) == ds)
+		return;
+	while(spi->SR & SPI_SR_FTLVL);
+	while(spi->SR & SPI_SR_BSY);
+	spi->CR2 = (spi->CR2 & ~SPI_CR2_DS) | ds;
+}
+#endif
+
+/*
+ * Waits for the last frame to leave so CS or DC can change, then throws
+ * away whatever was clocked in so the receive FIFO doesn't overflow.
+ */
+void spi_drain(SPI_TypeDef *spi) {
+	while(spi->SR & SPI_SR_FTLVL);
+	while(spi->SR & SPI_SR_BSY);
+
+	while(spi->SR & SPI_SR_FRLVL)
+		(void)*(__IO uint8_t *)&spi->DR;
+	(void)spi->SR;
+}
+
+/*
+ * Writes bytes to the SPI data register as fast as the FIFO takes them and
+ * waits for them to go. With SPI_16BIT_FRAMES pairs of bytes go as one
+ * frame, high byte first, and the frame size is back to 8 bits when this
+ * returns. The SPI must be on and not sending anything else.
+ */
+void spi_write_registers(SPI_TypeDef *spi, const uint8_t *data, unsigned int len) {
+#if SPI_16BIT_FRAMES
+	if(len >= 2) {
+		spi_frame_size(spi, 16);
+		for(; len >= 2; len -= 2, data += 2) {
+			while(!(spi->SR & SPI_SR_TXE));
+			*(__IO uint16_t *)&spi->DR = (data[0] << 8) | data[1];
+		}
+		spi_frame_size(spi, 8);
+	}
+#endif
+	while(len--) {
+		while(!(spi->SR & SPI_SR_TXE));
+		//A byte access so only 8 bits go in to the FIFO
+		*(__IO uint8_t *)&spi->DR = *data++;
+	}
+	spi_drain(spi);
+}
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ * Bar graph and gauge widgets for the ILI9488.
+ *
+ * The widgets remember what they last drew and only send the pixels that
+ * change. A bar that goes up by 3 pixels only fills a 3 pixel strip, and a
+ * gauge only redraws the parts of the old and new needle that don't overlap.
+ *
+ * File:   widgets.c
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+
+#include "widgets.h"
+#include <math.h>
+
+#define GAUGE_NEEDLE_WIDTH 5
+
+/*
+ * Sets up a bar and draws it empty
+ */
+void bar_init(bar_graph *bar, int x, int y, int width, int height, int min, int max,
+		unsigned int colour, unsigned int bg_colour, int direction) {
+	if(max == min)
+		max = min + 1;
+
+	bar->x = x;
+	bar->y = y;
+	bar->width = width;
+	bar->height = height;
+	bar->min = min;
+	bar->max = max;
+	bar->colour = colour;
+	bar->bg_colour = bg_colour;
+	bar->direction = direction;
+	bar->filled = 0;
+
+	fill_rectangle(x, y, x + width, y + height, bg_colour);
+}
+
+/*
+ * Fills part of the bar, from pixel start to end along its length
+ */
+void bar_fill(bar_graph *bar, int start, int end, unsigned int colour) {
+	if(bar->direction == BAR_VERTICAL)
+		fill_rectangle(bar->x, bar->y + bar->height - end, bar->x + bar->width, bar->y + bar->height - start, colour);
+	else
+		fill_rectangle(bar->x + start, bar->y, bar->x + end, bar->y + bar->height, colour);
+}
+
+/*
+ * Sets the value of the bar. Only the strip between the old and new value
+ * is drawn, in colour if it grew or the background colour if it shrank.
+ */
+void bar_set(bar_graph *bar, int value) {
+	int length = (bar->direction == BAR_VERTICAL) ? bar->height : bar->width;
+	int filled;
+
+	if(value <= bar->min)
+		filled = 0;
+	else if(value >= bar->max)
+		filled = length;
+	else
+		filled = (int)(((int64_t)(value - bar->min) * length) / (bar->max - bar->min));
+
+	if(filled > bar->filled)
+		bar_fill(bar, bar->filled, filled, bar->colour);
+	else if(filled < bar->filled)
+		bar_fill(bar, filled, bar->filled, bar->bg_colour);
+	bar->filled = filled;
+}
+
+/*
+ * Sets up a gauge centred on x, y and draws the needle at min. The dial
+ * itself should already be drawn in bg_colour.
+ */
+void gauge_init(gauge *g, int x, int y, int radius, int min, int max, int start_angle, int sweep,
+		unsigned int colour, unsigned int bg_colour) {
+	if(max == min)
+		max = min + 1;
+
+	g->x = x;
+	g->y = y;
+	g->radius = radius;
+	g->needle_width = GAUGE_NEEDLE_WIDTH;
+	g->min = min;
+	g->max = max;
+	g->start_angle = start_angle;
+	g->sweep = sweep;
+	g->colour = colour;
+	g->bg_colour = bg_colour;
+	g->drawn = 0;
+
+	gauge_set(g, min);
+}
+
+/*
+ * Works out the corners of the needle, a thin triangle from the centre to
+ * the tip. px[0], py[0] is the tip.
+ */
+void needle_points(gauge *g, float angle, float *px, float *py) {
+	float radians = angle * 3.14159265f / 180.0f;
+	float dx = sinf(radians);
+	float dy = -cosf(radians);
+	float half = g->needle_width / 2.0f;
+
+	//Pixel centres are at + 0.5
+	float cx = g->x + 0.5f;
+	float cy = g->y + 0.5f;
+
+	px[0] = cx + dx * g->radius;
+	py[0] = cy + dy * g->radius;
+	px[1] = cx - dy * half;
+	py[1] = cy + dx * half;
+	px[2] = cx + dy * half;
+	py[2] = cy - dx * half;
+}
+
+/*
+ * Finds the pixels the needle triangle px, py (from needle_points()) covers
+ * on row y, from x1 to x2 (exclusive).
+ * Returns 0 if it doesn't cover any.
+ */
+int needle_span(float *px, float *py, int y, int *x1, int *x2) {
+	float row = y + 0.5f;
+	float lo = 1e9f, hi = -1e9f;
+	float x;
+	int i, j;
+
+	for(i = 0; i < 3; i++) {
+		j = (i + 1) % 3;
+		if((row < py[i] && row < py[j]) || (row > py[i] && row > py[j]))
+			continue;
+		if(py[i] == py[j]) {
+			x = (px[i] < px[j]) ? px[i] : px[j];
+			if(x < lo)
+				lo = x;
+			x = (px[i] > px[j]) ? px[i] : px[j];
+			if(x > hi)
+				hi = x;
+			continue;
+		}
+		x = px[i] + (row - py[i]) * (px[j] - px[i]) / (py[j] - py[i]);
+		if(x < lo)
+			lo = x;
+		if(x > hi)
+			hi = x;
+	}
+	if(lo > hi)
+		return 0;
+
+	//Pixels whose centre is inside, but at least one so the tip doesn't break up
+	*x1 = (int)ceilf(lo - 0.5f);
+	*x2 = (int)floorf(hi - 0.5f) + 1;
+	if(*x2 <= *x1) {
+		*x1 = (int)floorf((lo + hi) / 2.0f);
+		*x2 = *x1 + 1;
+	}
+	return 1;
+}
+
+/*
+ * Fills the part of the span a1 to a2 on row y that isn't in b1 to b2
+ */
+void fill_span_difference(int y, int a1, int a2, int b1, int b2, unsigned int colour) {
+	if(a2 <= a1)
+		return;
+	if(b2 <= b1 || b2 <= a1 || b1 >= a2) {
+		fill_rectangle(a1, y, a2, y + 1, colour);
+		return;
+	}
+	if(a1 < b1)
+		fill_rectangle(a1, y, b1, y + 1, colour);
+	if(b2 < a2)
+		fill_rectangle(b2, y, a2, y + 1, colour);
+}
+
+/*
+ * Moves the needle to value. Each row of the old needle that the new one
+ * doesn't cover is erased, and only the new pixels are drawn.
+ */
+void gauge_set(gauge *g, int value) {
+	float old_x[3], old_y[3], new_x[3], new_y[3];
+	float angle;
+	int y, y1, y2, i;
+	int a1, a2, b1, b2;
+
+	if(value < g->min)
+		value = g->min;
+	if(value > g->max)
+		value = g->max;
+	angle = g->start_angle + ((float)(value - g->min) * g->sweep) / (g->max - g->min);
+
+	if(g->drawn && angle == g->angle)
+		return;
+
+	needle_points(g, angle, new_x, new_y);
+	if(g->drawn)
+		needle_points(g, g->angle, old_x, old_y);
+	else
+		for(i = 0; i < 3; i++) {
+			old_x[i] = new_x[i];
+			old_y[i] = new_y[i];
+		}
+
+	//Rows covered by either needle
+	y1 = g->y;
+	y2 = g->y;
+	for(i = 0; i < 3; i++) {
+		if(floorf(old_y[i]) < y1)
+			y1 = floorf(old_y[i]);
+		if(floorf(new_y[i]) < y1)
+			y1 = floorf(new_y[i]);
+		if(ceilf(old_y[i]) > y2)
+			y2 = ceilf(old_y[i]);
+		if(ceilf(new_y[i]) > y2)
+			y2 = ceilf(new_y[i]);
+	}
+
+	//All the spans in one transaction, like sprite_update()
+	lcd_begin_transaction();
+	for(y = y1; y <= y2; y++) {
+		if(!g->drawn || !needle_span(old_x, old_y, y, &a1, &a2))
+			a1 = a2 = 0;
+		if(!needle_span(new_x, new_y, y, &b1, &b2))
+			b1 = b2 = 0;
+
+		fill_span_difference(y, a1, a2, b1, b2, g->bg_colour);
+		fill_span_difference(y, b1, b2, a1, a2, g->colour);
+	}
+	lcd_end_transaction();
+
+	g->angle = angle;
+	g->drawn = 1;
+}
@@ -0,0 +1,54 @@
+/*
+ * Bar graph and gauge widgets for the ILI9488
+ *
+ * File:   widgets.h
+ * Author: tommy
+ *
+ * Created on 19th October 2026
+ */
+
+#ifndef WIDGETS_H
+#define	WIDGETS_H
+
+#include "ILI9488.h"
+
+//Bar directions
+#define BAR_HORIZONTAL  0 //Fills from left to right
+#define BAR_VERTICAL    1 //Fills from bottom to top
+
+/*
+ * A bar graph or progress bar. filled is the number of pixels that are
+ * currently drawn in colour.
+ */
+typedef struct {
+	int x, y, width, height;
+	int min, max;
+	unsigned int colour, bg_colour;
+	int direction;
+	int filled;
+} bar_graph;
+
+/*
+ * A radial gauge with a needle. Angles are in degrees clockwise from
+ * straight up, so a start of -135 and sweep of 270 leaves a gap at the
+ * bottom. The needle is erased with bg_colour.
+ */
+typedef struct {
+	int x, y;		//Centre
+	int radius;		//Length of the needle
+	int needle_width;	//Width of the needle at the centre
+	int min, max;
+	int start_angle, sweep;
+	unsigned int colour, bg_colour;
+	float angle;	//Angle of the needle on the screen
+	int drawn;		//Set once the needle has been drawn
+} gauge;
+
+void bar_init(bar_graph *bar, int x, int y, int width, int height, int min, int max,
+		unsigned int colour, unsigned int bg_colour, int direction);
+void bar_set(bar_graph *bar, int value);
+void gauge_init(gauge *g, int x, int y, int radius, int min, int max, int start_angle, int sweep,
+		unsigned int colour, unsigned int bg_colour);
+void gauge_set(gauge *g, int value);
+
+#endif	/* WIDGETS_H */